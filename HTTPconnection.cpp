@@ -10,6 +10,9 @@ HTTPconnection::HTTPconnection() {
     fd_ = -1;
     addr_ = { 0 };
     isClose_ = true;
+    keepAlive_ = false;
+    iovCnt_ = iovIdx_ = 0;
+    toWrite_ = 0;
 };
 
 HTTPconnection::~HTTPconnection() { 
@@ -23,11 +26,17 @@ void HTTPconnection::initHTTPConn(int fd, const sockaddr_in& addr) {
     fd_ = fd;
     writeBuffer_.initPtr();
     readBuffer_.initPtr();
+    request_.init();
+    keepAlive_ = false;
+    iovCnt_ = iovIdx_ = 0;
+    toWrite_ = 0;
     isClose_ = false;
 }
 
 void HTTPconnection::closeHTTPConn() {
-    response_.unmapFile_();
+    for(int i = 0; i < MAX_PIPELINE; ++i) {
+        response_[i].unmapFile_();
+    }
     if(isClose_ == false){
         isClose_ = true; 
         userCount--;
@@ -66,67 +75,133 @@ ssize_t HTTPconnection::readBuffer(int* saveErrno) {
     return len;
 }
 
-/* 写方法,响应头和响应体是分开的，要用iov实现写操作 */
+/* 写方法，一批响应的响应头和响应体交错排在 iov_ 中，用一次 writev 发出；
+有 sendfile 响应体时，它前面的内存段带 MSG_MORE 发出，让响应头和文件数据合并成满的报文段 */
 ssize_t HTTPconnection::writeBuffer(int* saveErrno) {
     // 最后一次写入的长度
     ssize_t len = -1;
     do {
-        len = writev(fd_, iov_, iovCnt_);
+        if(iovFd_[iovIdx_] >= 0) {
+            off_t off = iovOff_[iovIdx_];
+            len = sendfile(fd_, iovFd_[iovIdx_], &off, iov_[iovIdx_].iov_len);
+        }
+        else {
+            int end = iovIdx_;
+            while(end < iovCnt_ && iovFd_[end] < 0) {
+                ++end;
+            }
+            if(end == iovCnt_) {
+                len = writev(fd_, iov_ + iovIdx_, end - iovIdx_);
+            }
+            else {
+                struct msghdr msg = {};
+                msg.msg_iov = iov_ + iovIdx_;
+                msg.msg_iovlen = end - iovIdx_;
+                len = sendmsg(fd_, &msg, MSG_MORE);
+            }
+        }
         if(len <= 0) {
             *saveErrno = errno;
             break;
         }
+        advanceIov_(len);
         // 缓存为空，传输完成
-        if(iov_[0].iov_len + iov_[1].iov_len  == 0) { break; } /* 传输结束 */
-        // 响应头已经写完，开始将iov_[1]中的文件内容写入fd
-        else if(static_cast<size_t>(len) > iov_[0].iov_len) {
-            // 更新响应体传输起点和长度
-            iov_[1].iov_base = (uint8_t*) iov_[1].iov_base + (len - iov_[0].iov_len);
-            iov_[1].iov_len -= (len - iov_[0].iov_len);
-            // 响应头不再需要传输
-            if(iov_[0].iov_len) {
-                // 响应头保存在写缓存中，全部回收即可
-                writeBuffer_.initPtr();
-                iov_[0].iov_len = 0;
-            }
+        if(toWrite_ == 0) { break; } /* 传输结束 */
+    } while(isET || writeBytes() > 10240);  // 一次最多传输 10KB 数据
+    return len;
+}
+
+void HTTPconnection::advanceIov_(size_t len) {
+    assert(len <= toWrite_);
+    toWrite_ -= len;
+    while(len > 0 && iovIdx_ < iovCnt_) {
+        if(len >= iov_[iovIdx_].iov_len) {
+            len -= iov_[iovIdx_].iov_len;
+            iov_[iovIdx_].iov_len = 0;
+            ++iovIdx_;
+        }
+        else if(iovFd_[iovIdx_] >= 0) {
+            // sendfile 只推进文件偏移，EAGAIN 后从这里继续
+            iovOff_[iovIdx_] += len;
+            iov_[iovIdx_].iov_len -= len;
+            len = 0;
         }
-        // 响应头还没传输完成
         else {
-            iov_[0].iov_base = (uint8_t*)iov_[0].iov_base + len; 
-            iov_[0].iov_len -= len; 
-            writeBuffer_.updateReadPtr(len);
+            iov_[iovIdx_].iov_base = (uint8_t*)iov_[iovIdx_].iov_base + len;
+            iov_[iovIdx_].iov_len -= len;
+            len = 0;
         }
-    } while(isET || writeBytes() > 10240);  // 一次最多传输 10KB 数据
-    return len;
+    }
+    // 响应头全部写出，回收写缓存
+    if(toWrite_ == 0) {
+        writeBuffer_.initPtr();
+    }
 }
 
 /* 处理方法：解析读缓存内的请求报文，判断是否完整 */
-// 不完整返回false，完整在写缓存内写入响应头，并获取响应体内容（文件）
+// 不完整返回false，解析状态保留到下次读到数据后继续；
+// 读缓存中已经到齐的流水线请求一次全部处理，响应按顺序排进同一批 iov_
 bool HTTPconnection::handleHTTPConn() {
-    request_.init();
-    if(readBuffer_.readableBytes() <= 0) {
+    size_t headOff[MAX_PIPELINE];
+    size_t headLen[MAX_PIPELINE];
+    int cnt = 0;
+    while(cnt < MAX_PIPELINE && readBuffer_.readableBytes() > 0) {
+        HTTPrequest::HTTP_CODE ret = request_.parse(readBuffer_);
+        if(ret == HTTPrequest::NO_REQUEST) {
+            break;
+        }
+        HTTPresponse& response = response_[cnt];
+        if(ret == HTTPrequest::GET_REQUEST) {
+            response.init(srcDir, request_.path(), request_.isKeepAlive(), 200, &request_);
+            keepAlive_ = request_.isKeepAlive();
+        }else {
+            std::cout<<"400!"<<std::endl;
+            //readBuffer_.printContent();
+            response.init(srcDir, request_.path(), false, 400);
+            keepAlive_ = false;
+        }
+        headOff[cnt] = writeBuffer_.readableBytes();
+        response.makeResponse(writeBuffer_);
+        headLen[cnt] = writeBuffer_.readableBytes() - headOff[cnt];
+        ++cnt;
+        // 不保持连接时后面的请求不再处理
+        if(!keepAlive_) {
+            break;
+        }
+    }
+    if(cnt == 0) {
         //std::cout<<"readBuffer is empty!"<<std::endl;
         return false;
     }
-    else if(request_.parse(readBuffer_)) {
-        response_.init(srcDir, request_.path(), request_.isKeepAlive(), 200);
-    }else {
-        std::cout<<"400!"<<std::endl;
-        //readBuffer_.printContent();
-        response_.init(srcDir, request_.path(), false, 400);
-    }
-
-    response_.makeResponse(writeBuffer_);
-    /* 响应头 */
-    iov_[0].iov_base = const_cast<char*>(writeBuffer_.curReadPtr());
-    iov_[0].iov_len = writeBuffer_.readableBytes();
-    iovCnt_ = 1;
 
-    /* 响应体 文件 */
-    if(response_.fileLen() > 0  && response_.file()) {
-        iov_[1].iov_base = response_.file();
-        iov_[1].iov_len = response_.fileLen();
-        iovCnt_ = 2;
+    // 写缓存的段是在追加过程中分配的，全部追加完再取各段的地址
+    iovCnt_ = iovIdx_ = 0;
+    toWrite_ = 0;
+    for(int i = 0; i < cnt; ++i) {
+        /* 响应头 */
+        int n = writeBuffer_.peekIov(headOff[i], headLen[i], iov_ + iovCnt_, MAX_IOV - iovCnt_ - 1);
+        assert(n > 0 && n <= 2);
+        for(int j = 0; j < n; ++j) {
+            iovFd_[iovCnt_ + j] = -1;
+        }
+        iovCnt_ += n;
+        toWrite_ += headLen[i];
+        /* 响应体 文件 */
+        if(response_[i].fileLen() > 0 && response_[i].fileFd() >= 0) {
+            iov_[iovCnt_].iov_base = nullptr;
+            iov_[iovCnt_].iov_len = response_[i].fileLen();
+            iovFd_[iovCnt_] = response_[i].fileFd();
+            iovOff_[iovCnt_] = response_[i].fileOffset();
+            toWrite_ += response_[i].fileLen();
+            ++iovCnt_;
+        }
+        else if(response_[i].fileLen() > 0  && response_[i].file()) {
+            iov_[iovCnt_].iov_base = response_[i].file();
+            iov_[iovCnt_].iov_len = response_[i].fileLen();
+            iovFd_[iovCnt_] = -1;
+            toWrite_ += response_[i].fileLen();
+            ++iovCnt_;
+        }
     }
     return true;
 }
@@ -5,6 +5,8 @@
 
 #include<arpa/inet.h> //sockaddr_in
 #include<sys/uio.h> //readv/writev
+#include<sys/sendfile.h> //sendfile
+#include<sys/socket.h> //sendmsg
 #include<iostream>
 #include<sys/types.h>
 #include<assert.h>
@@ -12,6 +14,7 @@
 #include "buffer.h"
 #include "HTTPrequest.h"
 #include "HTTPresponse.h"
+#include "timewheel.h"
 
 class HTTPconnection{
 public:
@@ -35,33 +38,56 @@ public:
     int getFd() const;
     sockaddr_in getAddr() const;
 
-    int writeBytes()
+    //还没写完的响应字节数
+    size_t writeBytes() const
     {
-        return iov_[1].iov_len+iov_[0].iov_len;
+        return toWrite_;
     }
 
+    //最后一个已处理请求是否要求保持连接
     bool isKeepAlive() const
     {
-        return request_.isKeepAlive();
+        return keepAlive_;
+    }
+
+    //时间轮模式下连接自带的定时器结点
+    TimeWheelNode* timerNode()
+    {
+        return &timerNode_;
     }
 
     static bool isET;
     static const char* srcDir;
     static std::atomic<int>userCount;
 
+    static const int MAX_PIPELINE = 8; //一批最多处理的流水线请求数
+    // 每个响应：响应头（不超过一个块，最多跨写缓冲区的两个段）加响应体
+    static const int MAX_IOV = 3 * MAX_PIPELINE;
+
 private:
+    void advanceIov_(size_t len); //已写出 len 字节，推进 iov_
+
     int fd_;                  //HTTP连接对应的描述符
     struct sockaddr_in addr_;
     bool isClose_;            //标记是否关闭连接
+    bool keepAlive_;
 
+    // 一批响应按请求顺序排列：响应头（在写缓冲区的段中）、响应体（缓存或映射的文件），合并成一次 writev；
+    // sendfile 发送的响应体在 iovFd_ 中记下描述符，iovOff_ 记下文件中的发送位置，把一批切成几段
     int iovCnt_;
-    struct iovec iov_[2];
+    int iovIdx_;              //第一个还没写完的 iov
+    size_t toWrite_;
+    struct iovec iov_[MAX_IOV];
+    int iovFd_[MAX_IOV];
+    off_t iovOff_[MAX_IOV];
 
     Buffer readBuffer_;       //读缓冲区
     Buffer writeBuffer_;      //写缓冲区
 
     HTTPrequest request_;    
-    HTTPresponse response_;
+    HTTPresponse response_[MAX_PIPELINE];
+
+    TimeWheelNode timerNode_;
 
 };
 
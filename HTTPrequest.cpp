@@ -2,101 +2,192 @@
 
 #include "HTTPrequest.h"
 
-const std::unordered_set<std::string> HTTPrequest::DEFAULT_HTML{
-            "/index", "/welcome", "/video", "/picture"};
+#include <algorithm>
 
 void HTTPrequest::init() {
-    method_ = path_ = version_ = body_ = "";
+    path_.clear();
+    method_ = version_ = body_ = Span{0, 0};
+    base_ = nullptr;
+    parsed_ = scanned_ = contentLen_ = 0;
+    keepAlive_ = false;
     state_ = REQUEST_LINE;
-    header_.clear();
+    headerCnt_ = 0;
     post_.clear();
 }
 
 bool HTTPrequest::isKeepAlive() const {
-    if(header_.count("Connection") == 1) {
-        return header_.find("Connection")->second == "keep-alive" && version_ == "1.1";
+    return keepAlive_;
+}
+
+HTTPrequest::Span HTTPrequest::span_(const char* begin, const char* end) const {
+    assert(begin >= base_ && end >= begin);
+    return Span{static_cast<uint32_t>(begin - base_), static_cast<uint32_t>(end - begin)};
+}
+
+StrView HTTPrequest::view_(const Span& span) const {
+    return StrView(base_ + span.off, span.len);
+}
+
+StrView HTTPrequest::header(StrView name) const {
+    for(size_t i = 0; i < headerCnt_; ++i) {
+        if(view_(header_[i].name).equalsIgnoreCase(name)) {
+            return view_(header_[i].value);
+        }
     }
-    return false;
+    return StrView();
 }
 
-bool HTTPrequest::parse(Buffer& buff) {
-    const char CRLF[] = "\r\n";
+const char* HTTPrequest::findLineEnd_(const char* begin, const char* end) const {
+    while(begin < end) {
+        const char* cr = static_cast<const char*>(memchr(begin, '\r', end - begin));
+        if(!cr || cr + 1 >= end) return nullptr;
+        if(cr[1] == '\n') return cr;
+        begin = cr + 1;
+    }
+    return nullptr;
+}
+
+/* 按行推进的状态机，直接在读缓冲区上切分，只记录各字段的偏移
+请求完整之前不移动读指针，所以各偏移始终相对于 curReadPtr；
+只解析第一个段中连续的部分，请求跨段时才把未读数据合并成一段 */
+HTTPrequest::HTTP_CODE HTTPrequest::parse(Buffer& buff) {
+    if(state_ == FINISH) {
+        init();
+    }
     if(buff.readableBytes() <= 0) {
-        return false;
+        return NO_REQUEST;
     }
     //std::cout<<"parse buff start:"<<std::endl;
     //buff.printContent();
     //std::cout<<"parse buff finish:"<<std::endl;
-    while(buff.readableBytes() && state_ != FINISH) {
-        const char* lineEnd = std::search(buff.curReadPtr(), buff.curWritePtrConst(), CRLF, CRLF + 2);
-        std::string line(buff.curReadPtr(), lineEnd);
+    base_ = buff.curReadPtr();
+    const char* end = base_ + buff.contiguousBytes();
+    while(state_ != FINISH) {
+        if(state_ == BODY) {
+            // 请求体按 Content-Length 等待到齐
+            size_t have = static_cast<size_t>(end - base_) - parsed_;
+            if(have < contentLen_) {
+                if(static_cast<size_t>(end - base_) < buff.readableBytes()) {
+                    // 预留的空间按已有数据翻倍，大请求体合并的总拷贝量仍是线性的
+                    size_t reserve = std::max<size_t>(buff.readableBytes(), Buffer::BLOCK_SIZE);
+                    base_ = buff.linearize(std::min(contentLen_ - have, reserve));
+                    end = base_ + buff.contiguousBytes();
+                    continue;
+                }
+                return NO_REQUEST;
+            }
+            parseDataBody_(base_ + parsed_, base_ + parsed_ + contentLen_);
+            parsed_ += contentLen_;
+            break;
+        }
+        const char* cur = base_ + parsed_;
+        const char* lineEnd = findLineEnd_(base_ + scanned_, end);
+        if(!lineEnd) {
+            // 不完整的行留到下次，最后一个字节可能是 CR，下次从它开始找
+            size_t len = end - base_;
+            scanned_ = len > parsed_ + 1 ? len - 1 : parsed_;
+            if(len > MAX_HEADER_SIZE) {
+                return BAD_REQUEST;
+            }
+            // 请求跨了段，合并到一个段里接着解析；各字段记的是相对请求起点的偏移，合并后仍然有效
+            if(len < buff.readableBytes()) {
+                base_ = buff.linearize(Buffer::BLOCK_SIZE);
+                end = base_ + buff.contiguousBytes();
+                continue;
+            }
+            return NO_REQUEST;
+        }
         switch(state_)
         {
         case REQUEST_LINE:
-            //std::cout<<"REQUEST: "<<line<<std::endl;
-            if(!parseRequestLine_(line)) {
-                return false;
+            // 忽略请求之间多余的空行
+            if(lineEnd == cur) {
+                break;
+            }
+            //std::cout<<"REQUEST: "<<std::string(cur, lineEnd)<<std::endl;
+            if(!parseRequestLine_(cur, lineEnd)) {
+                return BAD_REQUEST;
             }
-            parsePath_();
             break;    
         case HEADERS:
-            parseRequestHeader_(line);
-            if(buff.readableBytes() <= 2) {
-                state_ = FINISH;
+            // 空行表示请求头结束
+            if(lineEnd == cur) {
+                if(!parseHeadersEnd_()) {
+                    return BAD_REQUEST;
+                }
+            }
+            else if(!parseRequestHeader_(cur, lineEnd)) {
+                return BAD_REQUEST;
             }
-            break;
-        case BODY:
-            parseDataBody_(line);
             break;
         default:
             break;
         }
-        if(lineEnd == buff.curWritePtr()) { break; }
-        buff.updateReadPtrUntilEnd(lineEnd + 2);
+        parsed_ = scanned_ = lineEnd + 2 - base_;
+        if(parsed_ > MAX_HEADER_SIZE && state_ != BODY && state_ != FINISH) {
+            return BAD_REQUEST;
+        }
     }
-    return true;
+    // 整个请求从缓冲区取走，视图指向的内存在下一次读入前仍然有效
+    buff.updateReadPtr(parsed_);
+    StrView conn = header("Connection");
+    keepAlive_ = conn.equalsIgnoreCase("keep-alive") && view_(version_) == "1.1";
+    return GET_REQUEST;
 }
 
-void HTTPrequest::parsePath_() {
-    if(path_ == "/") {
-        path_ = "/index.html"; 
+/* 没有 Content-Length 的请求没有请求体 */
+bool HTTPrequest::parseHeadersEnd_() {
+    StrView len = header("Content-Length");
+    contentLen_ = 0;
+    if(len.empty()) {
+        state_ = FINISH;
+        return true;
     }
-    else {
-        for(auto &item: DEFAULT_HTML) {
-            if(item == path_) {
-                path_ += ".html";
-                break;
-            }
+    for(size_t i = 0; i < len.size(); ++i) {
+        if(len[i] < '0' || len[i] > '9' || contentLen_ > (SIZE_MAX - 9) / 10) {
+            return false;
         }
+        contentLen_ = contentLen_ * 10 + (len[i] - '0');
     }
+    state_ = contentLen_ > 0 ? BODY : FINISH;
+    return true;
 }
 
-bool HTTPrequest::parseRequestLine_(const std::string& line) {
-    std::regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
-    std::smatch subMatch;
-    if(regex_match(line, subMatch, patten)) {   
-        method_ = subMatch[1];
-        path_ = subMatch[2];
-        version_ = subMatch[3];
-        state_ = HEADERS;
-        return true;
+/* 请求行：方法 SP 路径 SP HTTP/版本 */
+bool HTTPrequest::parseRequestLine_(const char* begin, const char* end) {
+    const char* sp1 = static_cast<const char*>(memchr(begin, ' ', end - begin));
+    if(!sp1) return false;
+    const char* sp2 = static_cast<const char*>(memchr(sp1 + 1, ' ', end - sp1 - 1));
+    if(!sp2) return false;
+    StrView proto(sp2 + 1, end - sp2 - 1);
+    if(!proto.startsWith("HTTP/") || proto.find(' ') != StrView::npos) {
+        return false;
     }
-    return false;
+    method_ = span_(begin, sp1);
+    path_.assign(sp1 + 1, sp2);
+    version_ = span_(proto.data() + 5, end);
+    state_ = HEADERS;
+    return true;
 }
 
-void HTTPrequest::parseRequestHeader_(const std::string& line) {
-    std::regex patten("^([^:]*): ?(.*)$");
-    std::smatch subMatch;
-    if(regex_match(line, subMatch, patten)) {
-        header_[subMatch[1]] = subMatch[2];
-    }
-    else {
-        state_ = BODY;
+/* 请求头：名字: 值，值两端的空白不计入 */
+bool HTTPrequest::parseRequestHeader_(const char* begin, const char* end) {
+    const char* colon = static_cast<const char*>(memchr(begin, ':', end - begin));
+    if(!colon || colon == begin || headerCnt_ >= MAX_HEADERS) {
+        return false;
     }
+    const char* value = colon + 1;
+    while(value < end && (*value == ' ' || *value == '\t')) ++value;
+    const char* valueEnd = end;
+    while(valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) --valueEnd;
+    header_[headerCnt_].name = span_(begin, colon);
+    header_[headerCnt_].value = span_(value, valueEnd);
+    ++headerCnt_;
+    return true;
 }
 
-void HTTPrequest::parseDataBody_(const std::string& line) {
-    body_ = line;
+void HTTPrequest::parseDataBody_(const char* begin, const char* end) {
+    body_ = span_(begin, end);
     parsePost_();
     state_ = FINISH;
 }
@@ -108,37 +199,39 @@ int HTTPrequest::convertHex(char ch) {
 }
 
 void HTTPrequest::parsePost_() {
-    if(method_ == "POST" && header_["Content-Type"] == "application/x-www-form-urlencoded") {
-        if(body_.size() == 0) { return; }
+    if(view_(method_) == "POST" && header("Content-Type") == "application/x-www-form-urlencoded") {
+        if(body_.len == 0) { return; }
 
+        // 表单需要解码后保存，这里才拷贝一份
+        std::string body = view_(body_).toString();
         std::string key, value;
         int num = 0;
-        int n = body_.size();
+        int n = body.size();
         int i = 0, j = 0;
 
         // 遍历 POST 请求的 body 部分
         for(; i < n; i++) {
-            char ch = body_[i];
+            char ch = body[i];
             switch (ch) {
             // 如果当前字符为等号，说明接下来的字符串为 key，需要进行截取
             case '=':
-                key = body_.substr(j, i - j);
+                key = body.substr(j, i - j);
                 j = i + 1;
                 break;
             // 如果当前字符为加号，需要将其替换为一个空格
             case '+':
-                body_[i] = ' ';
+                body[i] = ' ';
                 break;
             // 如果当前字符为百分号，说明接下来的两个字符为一个十六进制数，需要进行转换
             case '%':
-                num = convertHex(body_[i + 1]) * 16 + convertHex(body_[i + 2]);
-                body_[i + 2] = num % 10 + '0';
-                body_[i + 1] = num / 10 + '0';
+                num = convertHex(body[i + 1]) * 16 + convertHex(body[i + 2]);
+                body[i + 2] = num % 10 + '0';
+                body[i + 1] = num / 10 + '0';
                 i += 2;
                 break;
             // 如果当前字符为 &，说明接下来的字符串为 value，需要进行截取并存储
             case '&':
-                value = body_.substr(j, i - j);
+                value = body.substr(j, i - j);
                 j = i + 1;
                 post_[key] = value;
                 break;
@@ -149,7 +242,7 @@ void HTTPrequest::parsePost_() {
         // 处理最后一个键值对
         assert(j <= i);
         if(post_.count(key) == 0 && j < i) {
-            value = body_.substr(j, i - j);
+            value = body.substr(j, i - j);
             post_[key] = value;
         }
     }   
@@ -163,11 +256,11 @@ std::string& HTTPrequest::path(){
     return path_;
 }
 std::string HTTPrequest::method() const {
-    return method_;
+    return view_(method_).toString();
 }
 
 std::string HTTPrequest::version() const {
-    return version_;
+    return view_(version_).toString();
 }
 
 std::string HTTPrequest::getPost(const std::string& key) const {
@@ -4,11 +4,10 @@
 #define HTTP_REQUEST_H
 
 #include <unordered_map>
-#include <unordered_set>
 #include <string>
-#include <regex>
 
 #include "buffer.h"
+#include "strview.h"
 
 class HTTPrequest
 {
@@ -31,11 +30,18 @@ public:
         CLOSED_CONNECTION,
     };
 
+    static const size_t MAX_HEADERS = 64;
+    static const size_t MAX_HEADER_SIZE = 65536; //请求行加请求头的最大字节数
+
     HTTPrequest() {init();};
     ~HTTPrequest()=default;
 
     void init();
-    bool parse(Buffer& buff); //解析HTTP请求
+    // 解析HTTP请求，可以跨多次读取继续解析：
+    // 数据不够时返回 NO_REQUEST，不消耗不完整的行；完整时返回 GET_REQUEST 并从缓冲区取走整个请求；
+    // 格式错误返回 BAD_REQUEST。上一个请求完成后再次调用会自动开始解析下一个请求
+    HTTP_CODE parse(Buffer& buff);
+    bool isFinish() const {return state_ == FINISH;}
 
     //获取HTTP信息
     std::string path() const;
@@ -44,27 +50,48 @@ public:
     std::string version() const;
     std::string getPost(const std::string& key) const;
     std::string getPost(const char* key) const;
+    //按名字（不区分大小写）查找请求头，返回指向读缓冲区的视图，在缓冲区下一次读入前有效
+    StrView header(StrView name) const;
 
     bool isKeepAlive() const;
 
 private:
-    bool parseRequestLine_(const std::string& line);//解析请求行
-    void parseRequestHeader_(const std::string& line); //解析请求头
-    void parseDataBody_(const std::string& line); //解析数据体
+    /* 请求中的一段，以相对请求起点的偏移记录，不拷贝数据 */
+    struct Span {
+        uint32_t off;
+        uint32_t len;
+    };
+    struct HeaderField {
+        Span name;
+        Span value;
+    };
+
+    const char* findLineEnd_(const char* begin, const char* end) const; //找 CRLF，找不到返回 nullptr
+    bool parseHeadersEnd_(); //请求头结束，确定请求体长度
+    bool parseRequestLine_(const char* begin, const char* end);//解析请求行
+    bool parseRequestHeader_(const char* begin, const char* end); //解析请求头
+    void parseDataBody_(const char* begin, const char* end); //解析数据体
+
+    Span span_(const char* begin, const char* end) const;
+    StrView view_(const Span& span) const;
 
-    // 在解析请求行的时候，会解析出路径信息，之后还需要对路径信息做一个处理
-    void parsePath_();
     // 在处理数据体的时候，如果格式是 post，那么还需要解析 post 报文
     void parsePost_();
 
     static int convertHex(char ch);
 
     PARSE_STATE state_;
-    std::string method_,path_,version_,body_;
-    std::unordered_map<std::string,std::string>header_;
+    const char* base_;   //当前请求在读缓冲区中的起点，每次解析时重新取，跨段合并后偏移仍然有效
+    size_t parsed_;      //已经解析完的字节数（完整的行）
+    size_t scanned_;     //已经找过 CRLF 的位置，下次从这里继续找
+    size_t contentLen_;
+    bool keepAlive_;
+    Span method_,version_,body_;
+    std::string path_;   //需要补全后缀，单独保存，复用容量
+    HeaderField header_[MAX_HEADERS];
+    size_t headerCnt_;
     std::unordered_map<std::string,std::string>post_;
 
-    static const std::unordered_set<std::string>DEFAULT_HTML;
 };
 
 #endif  //HTTP_REQUEST_H
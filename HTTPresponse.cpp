@@ -26,9 +26,12 @@ const std::unordered_map<std::string, std::string> HTTPresponse::SUFFIX_TYPE = {
 
 const std::unordered_map<int, std::string> HTTPresponse::CODE_STATUS = {
     { 200, "OK" },
+    { 206, "Partial Content" },
+    { 304, "Not Modified" },
     { 400, "Bad Request" },
     { 403, "Forbidden" },
     { 404, "Not Found" },
+    { 416, "Range Not Satisfiable" },
 };
 
 const std::unordered_map<int, std::string> HTTPresponse::CODE_PATH = {
@@ -37,142 +40,562 @@ const std::unordered_map<int, std::string> HTTPresponse::CODE_PATH = {
     { 404, "/404.html" },
 };
 
+std::unordered_map<std::string, std::string> HTTPresponse::CACHE_CONTROL = {
+    { ".html",  "no-cache" },
+    { ".css",   "public, max-age=86400" },
+    { ".js",    "public, max-age=86400" },
+    { ".png",   "public, max-age=604800" },
+    { ".gif",   "public, max-age=604800" },
+    { ".jpg",   "public, max-age=604800" },
+    { ".jpeg",  "public, max-age=604800" },
+    { ".ico",   "public, max-age=604800" },
+    { ".woff",  "public, max-age=2592000" },
+    { ".woff2", "public, max-age=2592000" },
+    { ".ttf",   "public, max-age=2592000" },
+    { ".eot",   "public, max-age=2592000" },
+    { ".svg",   "public, max-age=2592000" },
+};
+
+std::string HTTPresponse::DEFAULT_CACHE_CONTROL = "no-cache";
+
+const char* HTTPresponse::DEFAULT_ERROR_MESSAGE = "File NotFound!";
+
+bool HTTPresponse::useSendfile = false;
+
+std::shared_ptr<const HTTPresponse::NotFoundPage> HTTPresponse::notFoundPage_;
+
 HTTPresponse::HTTPresponse() {
     code_ = -1;
     path_ = srcDir_ = "";
     isKeepAlive_ = false;
-    mmFile_ = nullptr; 
+    fileFd_ = -1;
     mmFileStat_ = { 0 };
+    bodyOff_ = bodyLen_ = 0;
+    gzip_ = false;
+    request_ = nullptr;
 };
 
 HTTPresponse::~HTTPresponse() {
     unmapFile_();
 }
 
-void HTTPresponse::init(const std::string& srcDir, std::string& path, bool isKeepAlive, int code){
+void HTTPresponse::init(const std::string& srcDir, std::string& path, bool isKeepAlive, int code,
+                        const HTTPrequest* request){
     assert(srcDir != "");
-    if(mmFile_) { unmapFile_(); }
+    unmapFile_();
     code_ = code;
     isKeepAlive_ = isKeepAlive;
     path_ = path;
     srcDir_ = srcDir;
-    mmFile_ = nullptr; 
     mmFileStat_ = { 0 };
+    bodyOff_ = bodyLen_ = 0;
+    gzip_ = false;
+    request_ = request;
 }
 
 void HTTPresponse::makeResponse(Buffer& buff) {
-    /* 判断请求的资源文件是否存在 */
-    if(stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)) {
+    /* 判断请求的资源文件是否存在，只查网站目录索引，不访问文件系统 */
+    resource_ = ResourceIndex::instance().find(path_);
+    if(!resource_) {
         code_ = 404;
+        // 不存在的路径直接用预先生成的 404 响应
+        if(notFound_(buff)) {
+            request_ = nullptr;
+            return;
+        }
     }
     // 查文件的权限是否可以读取
-    else if(!(mmFileStat_.st_mode & S_IROTH)) {
+    else if(!(resource_->st.st_mode & S_IROTH)) {
         code_ = 403;
     }
     else if(code_ == -1) { 
         code_ = 200; 
     }
+    if(code_ == 200) {
+        mmFileStat_ = resource_->st;
+        cached_ = FileCache::instance().get(resource_->file, mmFileStat_);
+    }
+    bodyOff_ = 0;
+    bodyLen_ = mmFileStat_.st_size;
+    if(code_ == 200) {
+        // 压缩版本是整个文件的另一种表示，区间请求只针对原文件
+        gzip_ = cached_ && !cached_->gzip.empty() && request_ && request_->header("Range").empty() &&
+                acceptGzip_(request_->header("Accept-Encoding"));
+        if(gzip_) {
+            bodyLen_ = cached_->gzip.size();
+        }
+        // 缓存仍然有效时只回 304，不打开也不映射文件
+        if(request_ && notModified_()) {
+            code_ = 304;
+        }
+        else if(request_) {
+            parseRange_(request_->header("Range"));
+        }
+    }
     errorHTML_();
     addStateLine_(buff);
     addResponseHeader_(buff);
     addResponseContent_(buff);
+    // 请求头的视图只在本次调用中有效
+    request_ = nullptr;
+}
+
+/* 预先生成的 404 响应：404.html 的缓存条目和 Date 之后的响应头，索引变化后重新生成
+404.html 不存在或不能缓存时返回 false，走普通的错误页面流程 */
+bool HTTPresponse::notFound_(Buffer& buff) {
+    uint64_t generation = ResourceIndex::instance().generation();
+    std::shared_ptr<const NotFoundPage> page = std::atomic_load(&notFoundPage_);
+    if(!page || page->generation != generation) {
+        std::shared_ptr<NotFoundPage> fresh = std::make_shared<NotFoundPage>();
+        fresh->generation = generation;
+        ResourcePtr res = ResourceIndex::instance().find(CODE_PATH.find(404)->second);
+        if(res && (res->st.st_mode & S_IROTH)) {
+            fresh->file = FileCache::instance().get(res->file, res->st);
+        }
+        if(fresh->file) {
+            fresh->tail = "Content-type: " + fresh->file->mime + "\r\nContent-length: " +
+                          std::to_string(fresh->file->data.size()) + "\r\n\r\n";
+        }
+        std::atomic_store(&notFoundPage_, std::shared_ptr<const NotFoundPage>(fresh));
+        page = fresh;
+    }
+    if(!page->file) {
+        return false;
+    }
+    cached_ = page->file;
+    mmFileStat_ = cached_->st;
+    bodyOff_ = 0;
+    bodyLen_ = cached_->data.size();
+    buff.append(*headerTemplate_(code_, isKeepAlive_));
+    appendDate_(buff);
+    buff.append(page->tail);
+    return true;
+}
+
+/* 命中缓存时直接用缓存里算好的校验值，不拷贝 */
+const std::string& HTTPresponse::currentETag_() const {
+    if(cached_) {
+        return gzip_ ? cached_->gzipEtag : cached_->etag;
+    }
+    return resource_->etag;
+}
+
+const std::string& HTTPresponse::currentLastModified_() const {
+    return cached_ ? cached_->lastModified : resource_->lastModified;
+}
+
+/* Accept-Encoding 中有 gzip（或 *）且 q 不为 0 时才发送压缩版本 */
+bool HTTPresponse::acceptGzip_(StrView list) {
+    size_t pos = 0;
+    while(pos < list.size()) {
+        size_t comma = list.find(',', pos);
+        if(comma == StrView::npos) {
+            comma = list.size();
+        }
+        StrView item = trim_(list.substr(pos, comma - pos));
+        StrView q;
+        size_t semi = item.find(';');
+        if(semi != StrView::npos) {
+            q = trim_(item.substr(semi + 1));
+            item = trim_(item.substr(0, semi));
+        }
+        if(item.equalsIgnoreCase("gzip") || item.equalsIgnoreCase("x-gzip") || item == StrView("*")) {
+            // q=0、q=0.0、q=0.000 表示不接受
+            if(!q.startsWith("q=0")) {
+                return true;
+            }
+            for(size_t i = 3; i < q.size(); ++i) {
+                if(q[i] != '.' && q[i] != '0') {
+                    return true;
+                }
+            }
+            return false;
+        }
+        pos = comma + 1;
+    }
+    return false;
+}
+
+StrView HTTPresponse::trim_(StrView str) {
+    while(!str.empty() && (str[0] == ' ' || str[0] == '\t')) {
+        str = str.substr(1);
+    }
+    while(!str.empty() && (str[str.size() - 1] == ' ' || str[str.size() - 1] == '\t')) {
+        str = str.substr(0, str.size() - 1);
+    }
+    return str;
+}
+
+/* If-None-Match 优先，没有时才看 If-Modified-Since */
+bool HTTPresponse::notModified_() const {
+    StrView inm = request_->header("If-None-Match");
+    if(!inm.empty()) {
+        return etagMatch_(inm, currentETag_());
+    }
+    StrView ims = request_->header("If-Modified-Since");
+    if(ims.empty()) {
+        return false;
+    }
+    // 浏览器一般原样带回 Last-Modified，先直接比较
+    if(ims == StrView(currentLastModified_())) {
+        return true;
+    }
+    struct tm tm = {};
+    std::string date = ims.toString();
+    const char* end = strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if(!end || *end != '\0') {
+        return false;
+    }
+    return mmFileStat_.st_mtime <= timegm(&tm);
+}
+
+/* If-None-Match 是逗号分隔的 ETag 列表或 *，按弱比较，忽略 W/ 前缀 */
+bool HTTPresponse::etagMatch_(StrView list, const std::string& etag) {
+    size_t pos = 0;
+    while(pos < list.size()) {
+        size_t comma = list.find(',', pos);
+        if(comma == StrView::npos) {
+            comma = list.size();
+        }
+        StrView tag = trim_(list.substr(pos, comma - pos));
+        if(tag.startsWith("W/")) {
+            tag = tag.substr(2);
+        }
+        if(tag == StrView("*") || tag == StrView(etag)) {
+            return true;
+        }
+        pos = comma + 1;
+    }
+    return false;
+}
+
+std::string HTTPresponse::makeETag(const struct stat& st) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "\"%lx-%lx-%lx\"", (unsigned long)st.st_ino, (unsigned long)st.st_size,
+             (unsigned long)(st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec));
+    return buf;
 }
 
-/* 获取映射好的文件 */
+std::string HTTPresponse::httpDate(time_t t) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buf[64];
+    size_t len = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(buf, len);
+}
+
+/* 文件相关的响应头：校验值、缓存策略、编码和类型，缓存的文件在加载时生成一次 */
+std::string HTTPresponse::fileHeaders(const std::string& path, const std::string& mime, const std::string& etag,
+                                      const std::string& lastModified, bool hasGzip, bool gzip) {
+    std::string::size_type idx = path.find_last_of('.');
+    auto it = idx == std::string::npos ? CACHE_CONTROL.end() : CACHE_CONTROL.find(path.substr(idx));
+    std::string headers;
+    headers += "Accept-Ranges: bytes\r\n";
+    headers += "ETag: " + etag + "\r\n";
+    headers += "Last-Modified: " + lastModified + "\r\n";
+    headers += "Cache-Control: " + (it == CACHE_CONTROL.end() ? DEFAULT_CACHE_CONTROL : it->second) + "\r\n";
+    if(hasGzip) {
+        if(gzip) {
+            headers += "Content-Encoding: gzip\r\n";
+        }
+        headers += "Vary: Accept-Encoding\r\n";
+    }
+    headers += "Content-type: " + mime + "\r\n";
+    return headers;
+}
+
+/* 状态行加 Connection 头，按状态码和是否保持连接在第一次使用时一次性生成 */
+const std::string* HTTPresponse::headerTemplate_(int code, bool keepAlive) {
+    static const std::vector<std::string> templates = [] {
+        std::vector<std::string> table(MAX_CODE * 2);
+        for(const auto& status : CODE_STATUS) {
+            std::string line = "HTTP/1.1 " + std::to_string(status.first) + " " + status.second + "\r\n";
+            table[status.first * 2] = line + "Connection: close\r\n";
+            table[status.first * 2 + 1] = line + "Connection: keep-alive\r\nkeep-alive: max=6, timeout=120\r\n";
+        }
+        return table;
+    }();
+    if(code < 0 || code >= MAX_CODE || templates[code * 2].empty()) {
+        return nullptr;
+    }
+    return &templates[code * 2 + keepAlive];
+}
+
+/* Date 头每个线程每秒只格式化一次 */
+void HTTPresponse::appendDate_(Buffer& buff) {
+    static thread_local time_t last = 0;
+    static thread_local char line[64];
+    static thread_local size_t len = 0;
+    time_t now = time(nullptr);
+    if(now != last) {
+        last = now;
+        len = snprintf(line, sizeof(line), "Date: %s\r\n", httpDate(now).c_str());
+    }
+    buff.append(line, len);
+}
+
+void HTTPresponse::appendNumber_(Buffer& buff, size_t num) {
+    char buf[24];
+    char* p = buf + sizeof(buf);
+    do {
+        *--p = '0' + num % 10;
+        num /= 10;
+    } while(num);
+    buff.append(p, buf + sizeof(buf) - p);
+}
+
+void HTTPresponse::setCacheControl(const std::string& suffix, const std::string& policy) {
+    if(suffix.empty()) {
+        DEFAULT_CACHE_CONTROL = policy;
+    }
+    else {
+        CACHE_CONTROL[suffix] = policy;
+    }
+}
+
+/* 解析 Range: bytes=a-b / bytes=a- / bytes=-n，只支持单个区间
+格式不对或有多个区间时忽略 Range，返回整个文件；区间起点超出文件时返回 416 */
+void HTTPresponse::parseRange_(StrView range) {
+    if(range.empty() || !S_ISREG(mmFileStat_.st_mode)) {
+        return;
+    }
+    if(!range.startsWith("bytes=")) {
+        return;
+    }
+    range = range.substr(6);
+    size_t dash = range.find('-');
+    if(dash == StrView::npos || range.find(',') != StrView::npos) {
+        return;
+    }
+    uint64_t first = 0, last = 0;
+    bool hasFirst = parseNumber_(range.substr(0, dash), first);
+    bool hasLast = parseNumber_(range.substr(dash + 1), last);
+    if((!hasFirst && dash != 0) || (!hasLast && dash + 1 != range.size())) {
+        return;
+    }
+    uint64_t size = mmFileStat_.st_size;
+    if(hasFirst) {
+        // bytes=a- 或 bytes=a-b，结尾超出文件时截到文件末尾
+        if(hasLast && last < first) {
+            return;
+        }
+        if(first >= size) {
+            code_ = 416;
+            return;
+        }
+        if(!hasLast || last >= size) {
+            last = size - 1;
+        }
+    }
+    else {
+        // bytes=-n，最后 n 个字节
+        if(!hasLast) {
+            return;
+        }
+        if(last == 0) {
+            code_ = 416;
+            return;
+        }
+        first = last >= size ? 0 : size - last;
+        last = size - 1;
+    }
+    code_ = 206;
+    bodyOff_ = first;
+    bodyLen_ = last - first + 1;
+}
+
+bool HTTPresponse::parseNumber_(StrView str, uint64_t& num) {
+    if(str.empty() || str.size() > 18) {
+        return false;
+    }
+    num = 0;
+    for(size_t i = 0; i < str.size(); ++i) {
+        if(str[i] < '0' || str[i] > '9') {
+            return false;
+        }
+        num = num * 10 + (str[i] - '0');
+    }
+    return true;
+}
+
+/* 获取要发送的文件内容，206 时指向区间的起点 */
 char* HTTPresponse::file() {
-    return mmFile_;
+    if(gzip_) {
+        return const_cast<char*>(cached_->gzip.data());
+    }
+    if(cached_) {
+        return const_cast<char*>(cached_->data.data()) + bodyOff_;
+    }
+    if(mapped_) {
+        return mapped_->addr + bodyOff_;
+    }
+    return nullptr;
 }
 
 size_t HTTPresponse::fileLen() const {
-    return mmFileStat_.st_size;
+    return bodyLen_;
 }
 
 void HTTPresponse::errorHTML_() {
     if(CODE_PATH.count(code_) == 1) {
         path_ = CODE_PATH.find(code_)->second;
-        stat((srcDir_ + path_).data(), &mmFileStat_);
+        resource_ = ResourceIndex::instance().find(path_);
+        cached_.reset();
+        mmFileStat_ = { 0 };
+        if(resource_) {
+            mmFileStat_ = resource_->st;
+            cached_ = FileCache::instance().get(resource_->file, mmFileStat_);
+        }
+        bodyOff_ = 0;
+        bodyLen_ = mmFileStat_.st_size;
     }
 }
 
 void HTTPresponse::addStateLine_(Buffer& buff) {
-    std::string status;
-    if(CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
-    }
-    else {
+    const std::string* head = headerTemplate_(code_, isKeepAlive_);
+    if(!head) {
         code_ = 400;
-        status = CODE_STATUS.find(400)->second;
+        head = headerTemplate_(code_, isKeepAlive_);
     }
-    buff.append("HTTP/1.1 " + std::to_string(code_) + " " + status + "\r\n");
+    buff.append(*head);
+    appendDate_(buff);
 }
 
 void HTTPresponse::addResponseHeader_(Buffer& buff) {
-    buff.append("Connection: ");
-    if(isKeepAlive_) {
-        buff.append("keep-alive\r\n");
-        buff.append("keep-alive: max=6, timeout=120\r\n");
-    } else{
-        buff.append("close\r\n");
+    if(code_ == 200 || code_ == 206 || code_ == 304) {
+        if(cached_) {
+            buff.append(gzip_ ? cached_->gzipHeaders : cached_->headers);
+        }
+        else {
+            buff.append(fileHeaders(resource_->file, resource_->mime, resource_->etag, resource_->lastModified, false, false));
+        }
+        return;
     }
-    buff.append("Content-type: " + getFileType_() + "\r\n");
+    buff.append("Content-type: ");
+    buff.append(getFileType_());
+    buff.append("\r\n");
 }
 
 void HTTPresponse::addResponseContent_(Buffer& buff) {
-    int srcFd = open((srcDir_ + path_).data(), O_RDONLY);
-    if(srcFd < 0) { 
-        errorContent(buff, "File NotFound!");
-        return; 
+    if(code_ == 304) {
+        bodyLen_ = 0;
+        buff.append("\r\n");
+        return;
     }
-
-    // 将文件映射到内存提高文件的访问速度 
-    // MAP_PRIVATE 建立一个写入时拷贝的私有映射
-    int* mmRet = (int*)mmap(0, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if(*mmRet == -1) {
-        errorContent(buff, "File NotFound!");
-        return; 
+    if(code_ == 416) {
+        unmapFile_();
+        bodyLen_ = 0;
+        buff.append("Content-Range: bytes */");
+        appendNumber_(buff, mmFileStat_.st_size);
+        buff.append("\r\nContent-length: 0\r\n\r\n");
+        return;
+    }
+    if(code_ == 206) {
+        buff.append("Content-Range: bytes ");
+        appendNumber_(buff, bodyOff_);
+        buff.append("-");
+        appendNumber_(buff, bodyOff_ + bodyLen_ - 1);
+        buff.append("/");
+        appendNumber_(buff, mmFileStat_.st_size);
+        buff.append("\r\n");
+    }
+    if(cached_) {
+        buff.append("Content-length: ");
+        appendNumber_(buff, bodyLen_);
+        buff.append("\r\n\r\n");
+        return;
     }
-    mmFile_ = (char*)mmRet;
-    close(srcFd);
-    buff.append("Content-length: " + std::to_string(mmFileStat_.st_size) + "\r\n\r\n");
+    if(!resource_) {
+        bodyLen_ = 0;
+        errorContent(buff, DEFAULT_ERROR_MESSAGE);
+        return;
+    }
+    // 借用共享映射中要发送的一段，不再每个响应映射一次；
+    // sendfile 模式下或映射失败时保留描述符，由连接直接从文件发送
+    if(!useSendfile) {
+        mapped_ = MmapRegistry::instance().get(resource_->file, mmFileStat_);
+    }
+    if(!mapped_) {
+        fileFd_ = open(resource_->file.data(), O_RDONLY);
+        if(fileFd_ < 0) {
+            bodyLen_ = 0;
+            errorContent(buff, DEFAULT_ERROR_MESSAGE);
+            return;
+        }
+    }
+    buff.append("Content-length: ");
+    appendNumber_(buff, bodyLen_);
+    buff.append("\r\n\r\n");
 }
 
-/* 解除文件映射 */
+/* 释放对缓存条目、共享映射和索引条目的引用，关闭 sendfile 用的描述符 */
 void HTTPresponse::unmapFile_() {
-    if(mmFile_) {
-        munmap(mmFile_, mmFileStat_.st_size);
-        mmFile_ = nullptr;
+    cached_.reset();
+    resource_.reset();
+    if(fileFd_ >= 0) {
+        close(fileFd_);
+        fileFd_ = -1;
     }
+    mapped_.reset();
 }
 
-std::string HTTPresponse::getFileType_() {
+const std::string& HTTPresponse::getFileType_() {
+    if(cached_) {
+        return cached_->mime;
+    }
+    if(resource_) {
+        return resource_->mime;
+    }
+    return fileType(path_);
+}
+
+const std::string& HTTPresponse::fileType(const std::string& path) {
+    static const std::string DEFAULT_TYPE = "text/plain";
     /* 判断文件类型 */
-    std::string::size_type idx = path_.find_last_of('.');
+    std::string::size_type idx = path.find_last_of('.');
     if(idx == std::string::npos) {
-        return "text/plain";
+        return DEFAULT_TYPE;
     }
-    std::string suffix = path_.substr(idx);
-    if(SUFFIX_TYPE.count(suffix) == 1) {
-        return SUFFIX_TYPE.find(suffix)->second;
+    auto it = SUFFIX_TYPE.find(path.substr(idx));
+    if(it != SUFFIX_TYPE.end()) {
+        return it->second;
     }
-    return "text/plain";
+    return DEFAULT_TYPE;
 }
 
-/* 范围外错误页面 */
+/* 范围外错误页面，默认提示语的页面按状态码预先生成 */
 void HTTPresponse::errorContent(Buffer& buff, std::string message) 
 {
-    std::string body;
+    static const std::unordered_map<int, std::string> pages = [] {
+        std::unordered_map<int, std::string> table;
+        for(const auto& status : CODE_STATUS) {
+            table[status.first] = errorPage_(status.first, status.second, DEFAULT_ERROR_MESSAGE);
+        }
+        return table;
+    }();
+    auto it = pages.find(code_);
+    if(message == DEFAULT_ERROR_MESSAGE && it != pages.end()) {
+        buff.append(it->second);
+        return;
+    }
     std::string status;
-    body += "<html><title>Error</title>";
-    body += "<body bgcolor=\"ffffff\">";
     if(CODE_STATUS.count(code_) == 1) {
         status = CODE_STATUS.find(code_)->second;
     } else {
         status = "Bad Request";
     }
-    body += std::to_string(code_) + " : " + status  + "\n";
+    buff.append(errorPage_(code_, status, message));
+}
+
+/* 生成 Content-length 和错误页面 */
+std::string HTTPresponse::errorPage_(int code, const std::string& status, const std::string& message)
+{
+    std::string body;
+    body += "<html><title>Error</title>";
+    body += "<body bgcolor=\"ffffff\">";
+    body += std::to_string(code) + " : " + status  + "\n";
     body += "<p>" + message + "</p>";
     body += "<hr><em>TinyWebServer</em></body></html>";
 
-    buff.append("Content-length: " + std::to_string(body.size()) + "\r\n\r\n");
-    buff.append(body);
+    return "Content-length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
 }
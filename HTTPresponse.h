@@ -4,13 +4,18 @@
 #define HTTP_RESPONSE_H
 
 #include <unordered_map>
+#include <vector>
 #include <fcntl.h>  //open
 #include <unistd.h> //close
 #include <sys/stat.h> //stat
-#include <sys/mman.h> //mmap,munmap
+#include <time.h> //gmtime_r,strptime,timegm
 #include <assert.h>
 
 #include "buffer.h"
+#include "filecache.h"
+#include "mmapregistry.h"
+#include "resourceindex.h"
+#include "HTTPrequest.h"
 
 class HTTPresponse
 {
@@ -18,23 +23,56 @@ public:
     HTTPresponse();
     ~HTTPresponse();
 
-    void init(const std::string& srcDir,std::string& path,bool isKeepAlive=false,int code=-1);
+    // request 用来读取 Range 等请求头，只在随后的 makeResponse 中使用
+    void init(const std::string& srcDir,std::string& path,bool isKeepAlive=false,int code=-1,
+              const HTTPrequest* request=nullptr);
     void makeResponse(Buffer& buffer);
     void unmapFile_();
     char* file();
     size_t fileLen() const;
+    // sendfile 模式下未缓存文件的描述符，没有时为 -1，从 fileOffset() 开始发送 fileLen() 字节
+    int fileFd() const {return fileFd_;}
+    off_t fileOffset() const {return bodyOff_;}
     void errorContent(Buffer& buffer,std::string message);
     int code() const {return code_;}
 
+    // 按后缀名取文件类型
+    static const std::string& fileType(const std::string& path);
+    // 由 inode、大小和修改时间生成强 ETag
+    static std::string makeETag(const struct stat& st);
+    // 格式化为 HTTP 日期，如 Wed, 22 Jul 2009 19:15:56 GMT
+    static std::string httpDate(time_t t);
+    // 生成文件相关的响应头（ETag、Last-Modified、Cache-Control、编码、类型）
+    static std::string fileHeaders(const std::string& path, const std::string& mime, const std::string& etag,
+                                   const std::string& lastModified, bool hasGzip, bool gzip);
+    // 设置某个后缀名的 Cache-Control，suffix 为空时设置默认策略，需在启动时调用
+    static void setCacheControl(const std::string& suffix, const std::string& policy);
+
+    // 为 true 时不缓存的文件用 sendfile 发送，不借用共享映射
+    static bool useSendfile;
+
 
 private:
     void addStateLine_(Buffer& buffer);
     void addResponseHeader_(Buffer& buffer);
     void addResponseContent_(Buffer& buffer);
+    void parseRange_(StrView range);
+    bool notFound_(Buffer& buff);
+    const std::string& currentETag_() const;
+    const std::string& currentLastModified_() const;
+    static const std::string* headerTemplate_(int code, bool keepAlive);
+    static void appendDate_(Buffer& buff);
+    static void appendNumber_(Buffer& buff, size_t num);
+    static std::string errorPage_(int code, const std::string& status, const std::string& message);
+    bool notModified_() const;
+    static bool etagMatch_(StrView list, const std::string& etag);
+    static bool acceptGzip_(StrView list);
+    static StrView trim_(StrView str);
+    static bool parseNumber_(StrView str,uint64_t& num);
 
     // 针对 4XX 的状态码
     void errorHTML_();
-    std::string getFileType_();
+    const std::string& getFileType_();
 
     int code_;
     bool isKeepAlive_;
@@ -42,14 +80,37 @@ private:
     std::string path_;
     std::string srcDir_;
 
-    // 使用了共享内存
-    char* mmFile_;
+    // 请求的文件在索引中的条目
+    ResourcePtr resource_;
+    // 缓存命中时直接引用缓存中的文件内容，不缓存的大文件借用共享映射
+    FilePtr cached_;
+    MappingPtr mapped_;
+    int fileFd_;
     struct  stat mmFileStat_;
+    // 要发送的部分在文件中的偏移和长度，200 时为整个文件
+    size_t bodyOff_;
+    size_t bodyLen_;
+    bool gzip_;       //发送缓存中的 gzip 版本
+
+    const HTTPrequest* request_;
+
 
     // SUFFIX_TYPE 表示后缀名到文件类型的映射关系，CODE_STATUS 表示状态码到相应状态 (字符串类型) 的映射。
     static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;
     static const std::unordered_map<int, std::string> CODE_STATUS;
     static const std::unordered_map<int, std::string> CODE_PATH;
+    // 后缀名到 Cache-Control 的映射，没有的后缀用 DEFAULT_CACHE_CONTROL
+    static std::unordered_map<std::string, std::string> CACHE_CONTROL;
+    static std::string DEFAULT_CACHE_CONTROL;
+    static const char* DEFAULT_ERROR_MESSAGE;
+    static const int MAX_CODE = 600;
+
+    struct NotFoundPage {
+        uint64_t generation;  //生成时的索引版本
+        FilePtr file;         //404.html
+        std::string tail;     //Content-type 和 Content-length
+    };
+    static std::shared_ptr<const NotFoundPage> notFoundPage_;
 };
 
 #endif //HTTP_RESPONSE_H
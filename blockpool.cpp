@@ -0,0 +1,42 @@
+// encode UTF-8
+
+#include "blockpool.h"
+
+const size_t BlockPool::BLOCK_SIZE;
+const size_t BlockPool::MAX_FREE_BLOCKS;
+
+BlockPool& BlockPool::instance()
+{
+    static BlockPool pool;
+    return pool;
+}
+
+BlockPool::~BlockPool()
+{
+    for(char* block:free_) delete[] block;
+}
+
+char* BlockPool::get()
+{
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if(!free_.empty()) {
+            char* block=free_.back();
+            free_.pop_back();
+            return block;
+        }
+    }
+    return new char[BLOCK_SIZE];
+}
+
+void BlockPool::put(char* block)
+{
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if(free_.size()<MAX_FREE_BLOCKS) {
+            free_.push_back(block);
+            return;
+        }
+    }
+    delete[] block;
+}
@@ -0,0 +1,30 @@
+// encode UTF-8
+
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#include <vector>
+#include <mutex>
+
+/* 缓冲区用的定长内存块的全局空闲表
+各连接的 Buffer 从这里取块、用完放回，避免反复 new/delete；
+空闲表最多保留 MAX_FREE_BLOCKS 块，多出来的直接还给系统 */
+class BlockPool {
+public:
+    static const size_t BLOCK_SIZE = 16 * 1024;
+    static const size_t MAX_FREE_BLOCKS = 1024;
+
+    static BlockPool& instance();
+
+    char* get();
+    void put(char* block);
+
+private:
+    BlockPool() = default;
+    ~BlockPool();
+
+    std::mutex mtx_;
+    std::vector<char*> free_;
+};
+
+#endif //BLOCK_POOL_H
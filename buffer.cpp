@@ -2,78 +2,151 @@
 
 #include "buffer.h"
 
-Buffer::Buffer(int initBuffersize):buffer_(initBuffersize),readPos_(0),writePos_(0){}
+#include<algorithm>
+
+const size_t Buffer::BLOCK_SIZE;
+const int Buffer::MAX_IOV;
+
+Buffer::Buffer():head_(0),readable_(0),spare_(nullptr){}
+
+Buffer::~Buffer()
+{
+    for(const Segment& seg:segs_)
+    {
+        freeSegment_(seg);
+    }
+    if(spare_) BlockPool::instance().put(spare_);
+}
 
 size_t Buffer::readableBytes() const
 {
-    return writePos_-readPos_;
+    return readable_;
 }
 
 size_t Buffer::writeableBytes() const
 {
-    return buffer_.size()-writePos_;
+    return segs_.empty()?0:segs_.back().cap-segs_.back().writePos;
+}
+
+size_t Buffer::contiguousBytes() const
+{
+    return segs_.empty()?0:segs_[head_].writePos-segs_[head_].readPos;
 }
 
 size_t Buffer::readBytes() const
 {
-    return readPos_;
+    return segs_.empty()?0:segs_[head_].readPos;
 }
 
 const char* Buffer::curReadPtr() const
 {
-    return BeginPtr_()+readPos_;
+    return segs_.empty()?nullptr:segs_[head_].data+segs_[head_].readPos;
 }
 
 const char* Buffer::curWritePtrConst() const
 {
-    return BeginPtr_()+writePos_;
+    return segs_.empty()?nullptr:segs_.back().data+segs_.back().writePos;
 }
 
 char* Buffer::curWritePtr()
 {
-    return BeginPtr_()+writePos_;
+    return segs_.empty()?nullptr:segs_.back().data+segs_.back().writePos;
 }
 
 void Buffer::updateReadPtr(size_t len)
 {
     assert(len<=readableBytes());
-    readPos_+=len;
+    readable_-=len;
+    while(true)
+    {
+        // 读完的段跳过，但不归还，尾段读完时停在尾段上
+        while(head_+1<segs_.size() && segs_[head_].readPos==segs_[head_].writePos)
+        {
+            ++head_;
+        }
+        if(len==0) break;
+        Segment& seg=segs_[head_];
+        size_t n=std::min(len,seg.writePos-seg.readPos);
+        seg.readPos+=n;
+        len-=n;
+    }
 }
 
 void Buffer::updateReadPtrUntilEnd(const char* end)
 {
-    assert(end>=curReadPtr());
+    assert(end>=curReadPtr() && end<=curReadPtr()+contiguousBytes());
     updateReadPtr(end-curReadPtr());
 }
 
 void Buffer::updateWritePtr(size_t len)
 {
     assert(len<=writeableBytes());
-    writePos_+=len;
+    segs_.back().writePos+=len;
+    readable_+=len;
 }
 
 void Buffer::initPtr()
 {
-    bzero(&buffer_[0],buffer_.size());
-    readPos_=0;
-    writePos_=0;
+    // 第一个段是池中的块就留着下次用，其余的都归还
+    bool keepFirst=!segs_.empty() && segs_[0].cap==BLOCK_SIZE;
+    for(size_t i=keepFirst?1:0;i<segs_.size();++i)
+    {
+        freeSegment_(segs_[i]);
+    }
+    segs_.resize(keepFirst?1:0);
+    if(keepFirst) segs_[0].readPos=segs_[0].writePos=0;
+    head_=0;
+    readable_=0;
 }
 
-void Buffer::allocateSpace(size_t len)
+Buffer::Segment Buffer::newSegment_(size_t cap)
 {
-    //如果buffer_里面剩余的空间有len就进行调整，否则需要申请空间。
-    //剩余空间包括write指针之前的空间和可写的空间
-    if(writeableBytes()+readBytes()<len)
+    if(cap<=BLOCK_SIZE)
     {
-        buffer_.resize(writePos_+len+1);
+        char* block=spare_;
+        spare_=nullptr;
+        if(!block) block=BlockPool::instance().get();
+        return Segment{block,BLOCK_SIZE,0,0};
     }
-    else{
-        //将读指针置为0,调整一下
-        size_t readable=readableBytes();
-        std::copy(BeginPtr_()+readPos_,BeginPtr_()+writePos_,BeginPtr_());
-        readPos_=0;
-        writePos_=readable;
-        assert(readable==readableBytes());
+    return Segment{new char[cap],cap,0,0};
+}
+
+void Buffer::freeSegment_(const Segment& seg)
+{
+    if(seg.cap!=BLOCK_SIZE)
+    {
+        delete[] seg.data;
+    }
+    else if(!spare_)
+    {
+        spare_=seg.data;
+    }
+    else
+    {
+        BlockPool::instance().put(seg.data);
+    }
+}
+
+void Buffer::releaseConsumed_()
+{
+    for(size_t i=0;i<head_;++i)
+    {
+        freeSegment_(segs_[i]);
+    }
+    segs_.erase(segs_.begin(),segs_.begin()+head_);
+    head_=0;
+    // 全部读完时唯一的段从头复用，为长请求临时分配的大段直接释放
+    if(segs_.size()==1 && readable_==0)
+    {
+        if(segs_[0].cap==BLOCK_SIZE)
+        {
+            segs_[0].readPos=segs_[0].writePos=0;
+        }
+        else
+        {
+            freeSegment_(segs_[0]);
+            segs_.clear();
+        }
     }
 }
 
@@ -81,17 +154,24 @@ void Buffer::ensureWriteable(size_t len)
 {
     if(writeableBytes()<len)
     {
-        allocateSpace(len);
+        segs_.push_back(newSegment_(len));
+        updateReadPtr(0);
     }
     assert(writeableBytes()>=len);
 }
 
 void Buffer::append(const char* str,size_t len)
 {
-    assert(str);
-    ensureWriteable(len);
-    std::copy(str,str+len,curWritePtr());
-    updateWritePtr(len);
+    assert(str || len==0);
+    while(len>0)
+    {
+        if(writeableBytes()==0) ensureWriteable(1);
+        size_t n=std::min(len,writeableBytes());
+        memcpy(curWritePtr(),str,n);
+        updateWritePtr(n);
+        str+=n;
+        len-=n;
+    }
 }
 
 void Buffer::append(const std::string& str)
@@ -107,23 +187,78 @@ void Buffer::append(const void* data,size_t len)
 
 void Buffer::append(const Buffer& buffer)
 {
-    append(buffer.curReadPtr(),buffer.readableBytes());
+    for(size_t i=buffer.head_;i<buffer.segs_.size();++i)
+    {
+        const Segment& seg=buffer.segs_[i];
+        append(seg.data+seg.readPos,seg.writePos-seg.readPos);
+    }
+}
+
+const char* Buffer::linearize(size_t reserve)
+{
+    releaseConsumed_();
+    size_t need=readable_+reserve;
+    if(segs_.size()==1 && segs_[0].cap-segs_[0].readPos>=need)
+    {
+        return curReadPtr();
+    }
+    Segment merged=newSegment_(need);
+    for(const Segment& seg:segs_)
+    {
+        memcpy(merged.data+merged.writePos,seg.data+seg.readPos,seg.writePos-seg.readPos);
+        merged.writePos+=seg.writePos-seg.readPos;
+    }
+    for(const Segment& seg:segs_)
+    {
+        freeSegment_(seg);
+    }
+    segs_.assign(1,merged);
+    head_=0;
+    return curReadPtr();
+}
+
+int Buffer::peekIov(size_t off,size_t len,struct iovec* iov,int maxIov) const
+{
+    int cnt=0;
+    for(size_t i=head_;i<segs_.size() && len>0 && cnt<maxIov;++i)
+    {
+        size_t avail=segs_[i].writePos-segs_[i].readPos;
+        if(off>=avail)
+        {
+            off-=avail;
+            continue;
+        }
+        size_t n=std::min(avail-off,len);
+        iov[cnt].iov_base=segs_[i].data+segs_[i].readPos+off;
+        iov[cnt].iov_len=n;
+        ++cnt;
+        len-=n;
+        off=0;
+    }
+    return cnt;
 }
 
 ssize_t Buffer::readFd(int fd,int* Errno)
 {
-    char buff[65535];//暂时的缓冲区
+    // 上一批请求的视图到这里才失效，读完的段此时归还
+    releaseConsumed_();
+    if(!spare_) spare_=BlockPool::instance().get();
     struct iovec iov[2];
+    int cnt=0;
     const size_t writable=writeableBytes();
 
-    // buff 为暂存区，buffer写满后会往buff中写
-    iov[0].iov_base=BeginPtr_()+writePos_;
-    iov[0].iov_len=writable;
-    iov[1].iov_base=buff;
-    iov[1].iov_len=sizeof(buff);
+    // 先填尾段剩余的空间，放不下的直接落在备用块里，备用块成为新的尾段，不再二次拷贝
+    if(writable>0)
+    {
+        iov[cnt].iov_base=curWritePtr();
+        iov[cnt].iov_len=writable;
+        ++cnt;
+    }
+    iov[cnt].iov_base=spare_;
+    iov[cnt].iov_len=BLOCK_SIZE;
+    ++cnt;
 
-    // readv会将读取的数据往iov中填充，iov[0]填满后往iov[1]继续填充
-    const ssize_t len=readv(fd,iov,2);
+    const ssize_t len=readv(fd,iov,cnt);
     if(len<0)
     {
         //std::cout<<"从fd读取数据失败！"<<std::endl;
@@ -131,44 +266,42 @@ ssize_t Buffer::readFd(int fd,int* Errno)
     }
     else if(static_cast<size_t>(len)<=writable)
     {
-        writePos_+=len;
+        updateWritePtr(len);
     }
-    // 此时writePos_指向buffer尾部，将buff中数据写进buffer中会导致扩容
-    else{
-        writePos_=buffer_.size();
-        append(buff,len-writable);
+    else
+    {
+        if(writable>0) updateWritePtr(writable);
+        segs_.push_back(Segment{spare_,BLOCK_SIZE,0,len-writable});
+        spare_=nullptr;
+        readable_+=len-writable;
+        updateReadPtr(0);
     }
     return len;
 }
 
 ssize_t Buffer::writeFd(int fd,int* Errno)
 {
-    size_t readSize=readableBytes();
-    ssize_t len=write(fd,curReadPtr(),readSize);
+    struct iovec iov[MAX_IOV];
+    int cnt=peekIov(0,readable_,iov,MAX_IOV);
+    ssize_t len=writev(fd,iov,cnt);
     if(len<0)
     {
         //std::cout<<"往fd写入数据失败！"<<std::endl;
         *Errno=errno;
         return len;
     }
-    readPos_+=len;
+    updateReadPtr(len);
     return len;
 }
 
 std::string Buffer::AlltoStr()
 {
-    std::string str(curReadPtr(),readableBytes());
+    std::string str;
+    str.reserve(readable_);
+    for(size_t i=head_;i<segs_.size();++i)
+    {
+        str.append(segs_[i].data+segs_[i].readPos,segs_[i].writePos-segs_[i].readPos);
+    }
     initPtr();
     return str;
 }
-
-char* Buffer::BeginPtr_()
-{
-    return &*buffer_.begin();
-}
-
-// 区分迭代器和指针的区别
-const char* Buffer::BeginPtr_() const
-{
-    return &*buffer_.begin();
-}
\ No newline at end of file
@@ -4,46 +4,64 @@
 #define BUFFER_H
 
 #include<vector>
+#include<string>
 #include<iostream>
 #include<cstring>
-#include<atomic>
 #include<unistd.h> //read() write()
 #include<sys/uio.h> //readv() writev()
 #include<assert.h>
 
+#include "blockpool.h"
+
+/* 分段的缓冲区：数据存放在一串段中，段一般是从 BlockPool 取的定长块
+追加和读入只往尾段的空闲处或新段里写，已经缓存的数据从不搬动，也不整体扩容；
+写出时把各段组成 iovec 一次发出。
+只有需要连续内存的解析（一个请求跨了段）才调用 linearize 把未读数据合并到一个段里 */
 class Buffer{
 public:
-    Buffer(int initBufferSize=1024);
-    ~Buffer()=default;
+    static const size_t BLOCK_SIZE = BlockPool::BLOCK_SIZE;
+    static const int MAX_IOV = 16; //writeFd 一次最多发出的段数
+
+    Buffer();
+    ~Buffer();
+    Buffer(const Buffer&)=delete;
+    Buffer& operator=(const Buffer&)=delete;
 
-    //缓存区中可以读取的字节数
+    //尾段中可以写入的字节数
     size_t writeableBytes() const;
-    //缓存区中可以写入的字节数
+    //缓存区中可以读取的字节数（所有段）
     size_t readableBytes() const;
-    //缓存区中已经读取的字节数
+    //第一个未读完的段中可以连续读取的字节数
+    size_t contiguousBytes() const;
+    //第一个未读完的段中已经读取的字节数
     size_t readBytes() const;
 
-    //获取当前读指针
+    //获取当前读指针，只保证 contiguousBytes() 个字节连续
     const char* curReadPtr() const;
-    //获取当前写指针
+    //获取尾段的写指针
     const char* curWritePtrConst() const;
     char* curWritePtr();
-    //更新读指针
+    //更新读指针，可以跨段；读完的段到下一次 readFd 时才归还，之前取得的指针仍然有效
     void updateReadPtr(size_t len);
     void updateReadPtrUntilEnd(const char* end);//将读指针直接更新到指定位置
     //更新写指针
     void updateWritePtr(size_t len);
-    //将读指针和写指针初始化
+    //清空缓冲区，只保留第一个段
     void initPtr();
 
-    //保证将数据写入缓冲区
+    //保证尾段有 len 字节连续的可写空间，不够时追加新段
     void ensureWriteable(size_t len);
-    //将数据写入到缓冲区
+    //将数据写入到缓冲区，尾段写满后接着写新段
     void append(const char* str,size_t len);
     void append(const std::string& str);
     void append(const void* data,size_t len);
     void append(const Buffer& buffer);
 
+    //把未读数据合并到一个段里，并在其后留出至少 reserve 字节空间，返回新的读指针
+    const char* linearize(size_t reserve);
+    //取未读数据中 [off, off+len) 这一段对应的 iovec，返回用掉的个数
+    int peekIov(size_t off,size_t len,struct iovec* iov,int maxIov) const;
+
     //IO操作的读与写接口
     ssize_t readFd(int fd,int* Errno);
     ssize_t writeFd(int fd,int* Errno);
@@ -54,25 +72,36 @@ public:
     //test
     void printContent()
     {
-        std::cout<<"pointer location info:"<<readPos_<<" "<<writePos_<<std::endl;
-        for(int i=readPos_;i<=writePos_;++i)
+        std::cout<<"pointer location info:"<<segs_.size()<<" segments, "<<readable_<<" bytes"<<std::endl;
+        for(size_t i=head_;i<segs_.size();++i)
         {
-            std::cout<<buffer_[i]<<" ";
+            for(size_t j=segs_[i].readPos;j<segs_[i].writePos;++j)
+            {
+                std::cout<<segs_[i].data[j]<<" ";
+            }
         }
         std::cout<<std::endl;
     }
 
 private:
-    //返回指向缓冲区初始位置的指针
-    char* BeginPtr_();
-    const char* BeginPtr_() const;
-    //用于缓冲区空间不够时的扩容
-    void allocateSpace(size_t len);
+    struct Segment {
+        char* data;
+        size_t cap;
+        size_t readPos;
+        size_t writePos;
+    };
+
+    //取一个至少 cap 字节的段，不超过 BLOCK_SIZE 的用池中的块
+    Segment newSegment_(size_t cap);
+    void freeSegment_(const Segment& seg);
+    //归还已经读完的段
+    void releaseConsumed_();
 
-    std::vector<char>buffer_; //buffer的实体
-    std::atomic<std::size_t>readPos_;//用于指示读指针
-    std::atomic<std::size_t>writePos_;//用于指示写指针
+    std::vector<Segment> segs_;
+    size_t head_;      //第一个未读完的段，之前的段已读完但还没归还
+    size_t readable_;  //所有段中未读的字节数
+    char* spare_;      //readFd 用来接收溢出数据的备用块，没用上时留到下次
 
 };
 
-# endif //BUFFER_H
\ No newline at end of file
+# endif //BUFFER_H
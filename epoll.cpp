@@ -1,14 +1,28 @@
 // encode UTF-8
 
 #include "epoller.h"
+#include "uringpoller.h"
 
 // epoll_create() 在内核中创建 epoll 实例并返回一个 epoll 文件描述符
 Epoller::Epoller(int maxEvent):epollerFd_(epoll_create(512)), events_(maxEvent){
     assert(epollerFd_ >= 0 && events_.size() > 0);
 }
 
+Epoller::Epoller(int maxEvent,int epollerFd):epollerFd_(epollerFd), events_(maxEvent){
+    assert(events_.size() > 0);
+}
+
 Epoller::~Epoller() {
-    close(epollerFd_);
+    if(epollerFd_ >= 0) close(epollerFd_);
+}
+
+Epoller* Epoller::create(bool useUring,int maxEvent) {
+    if(useUring) {
+        UringPoller* poller = new UringPoller(maxEvent);
+        if(poller->isValid()) return poller;
+        delete poller;
+    }
+    return new Epoller(maxEvent);
 }
 
 bool Epoller::addFd(int fd, uint32_t events) {
@@ -10,28 +10,35 @@
 #include<vector>
 #include<errno.h>
 
+/* 事件后端接口，默认实现为 epoll；UringPoller 以相同的语义用 io_uring 实现 */
 class Epoller{
 public:
     explicit Epoller(int maxEvent=1024);
-    ~Epoller();
+    virtual ~Epoller();
+
+    //按启动参数创建事件后端，io_uring 不可用时退回 epoll
+    static Epoller* create(bool useUring,int maxEvent=1024);
 
     //将描述符fd加入epoll监控
-    bool addFd(int fd,uint32_t events);
+    virtual bool addFd(int fd,uint32_t events);
     //修改描述符fd对应的事件
-    bool modFd(int fd,uint32_t events);
+    virtual bool modFd(int fd,uint32_t events);
     //将描述符fd移除epoll的监控
-    bool delFd(int fd);
+    virtual bool delFd(int fd);
     //用于返回监控的结果，成功时返回就绪的文件描述符的个数
-    int wait(int timewait = -1);
+    virtual int wait(int timewait = -1);
 
     //获取fd的函数
     int getEventFd(size_t i) const;
     //获取events的函数
     uint32_t getEvents(size_t i) const;
 
-private:
+protected:
+    //供其他后端使用，不创建epoll描述符
+    Epoller(int maxEvent,int epollerFd);
+
     int epollerFd_;//这是标志epoll的描述符
     std::vector<struct epoll_event>events_; //就绪的事件
 };
 
-#endif //EPOLLER_H
\ No newline at end of file
+#endif //EPOLLER_H
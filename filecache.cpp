@@ -0,0 +1,231 @@
+// encode UTF-8
+
+#include "filecache.h"
+#include "HTTPresponse.h"
+
+#include <cstring>
+#include <fcntl.h>  //open
+#include <unistd.h> //read,close
+#include <zlib.h>
+
+const std::unordered_set<std::string> FileCache::GZIP_SUFFIX = {
+    ".html", ".xml", ".xhtml", ".txt", ".css", ".js", ".json", ".svg", ".ttf", ".eot",
+};
+
+FileCache& FileCache::instance()
+{
+    static FileCache cache;
+    return cache;
+}
+
+FileCache::FileCache():capacity_(DEFAULT_CAPACITY),maxFile_(DEFAULT_MAX_FILE),bytes_(0)
+{
+}
+
+/* 只在启动时调用，运行中修改不保证已缓存的条目立即满足新的上限 */
+void FileCache::setLimits(size_t capacity,size_t maxFile)
+{
+    capacity_=capacity;
+    maxFile_=maxFile;
+}
+
+FilePtr FileCache::get(const std::string& path,const struct stat& st)
+{
+    Shard& shard=shard_(path);
+    FilePtr file;
+    {
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        auto it=shard.index.find(path);
+        if(it!=shard.index.end()) {
+            shard.lru.splice(shard.lru.begin(),shard.lru,it->second);
+            file=*it->second;
+        }
+    }
+    if(file) {
+        if(sameFile(st,file->st)) {
+            return file;
+        }
+        // 文件被修改或替换，旧条目作废
+        erase_(shard,file);
+    }
+    if(!cacheable_(st)) {
+        return nullptr;
+    }
+    file=load_(path,st);
+    if(file) {
+        insert_(shard,file);
+    }
+    return file;
+}
+
+void FileCache::preload(const std::string& path,const struct stat& st)
+{
+    if(!cacheable_(st)) {
+        remove(path);
+        return;
+    }
+    FilePtr file=load_(path,st,true);
+    if(file) {
+        insert_(shard_(path),file);
+    }
+}
+
+void FileCache::remove(const std::string& path)
+{
+    Shard& shard=shard_(path);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    auto it=shard.index.find(path);
+    if(it==shard.index.end()) return;
+    size_t size=(*it->second)->data.size()+(*it->second)->gzip.size();
+    shard.bytes-=size;
+    bytes_-=size;
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+}
+
+FileCache::Shard& FileCache::shard_(const std::string& path)
+{
+    return shards_[std::hash<std::string>()(path)%SHARDS];
+}
+
+/* 只缓存其他用户可读的小文件，目录、特殊文件和大文件仍然走原来的路径 */
+bool FileCache::cacheable_(const struct stat& st) const
+{
+    return S_ISREG(st.st_mode) && (st.st_mode & S_IROTH) &&
+           static_cast<size_t>(st.st_size)<=maxFile_;
+}
+
+/* 读入整个文件，以打开后的 fstat 为准，读取过程中文件被改动就放弃这次缓存 */
+FilePtr FileCache::load_(const std::string& path,const struct stat& st,bool compress)
+{
+    int fd=open(path.data(),O_RDONLY);
+    if(fd<0) return nullptr;
+    std::shared_ptr<CachedFile> file=std::make_shared<CachedFile>();
+    if(fstat(fd,&file->st)<0 || !sameFile(st,file->st)) {
+        close(fd);
+        return nullptr;
+    }
+    bool ok=readFile_(fd,file->st.st_size,file->data);
+    close(fd);
+    if(!ok) return nullptr;
+
+    file->path=path;
+    file->mime=HTTPresponse::fileType(path);
+    file->etag=HTTPresponse::makeETag(file->st);
+    file->lastModified=HTTPresponse::httpDate(file->st.st_mtime);
+    loadGzip_(*file,compress);
+    file->headers=HTTPresponse::fileHeaders(path,file->mime,file->etag,file->lastModified,
+                                            !file->gzip.empty(),false);
+    if(!file->gzip.empty()) {
+        file->gzipHeaders=HTTPresponse::fileHeaders(path,file->mime,file->gzipEtag,file->lastModified,
+                                                    true,true);
+    }
+    return file;
+}
+
+/* 优先使用不比原文件旧的 .gz 文件，没有时按需用 zlib 压缩，压缩后没有明显变小就不保留 */
+void FileCache::loadGzip_(CachedFile& file,bool compress)
+{
+    std::string::size_type idx=file.path.find_last_of('.');
+    if(idx==std::string::npos || GZIP_SUFFIX.count(file.path.substr(idx))==0) return;
+    if(file.data.size()<MIN_GZIP_SIZE) return;
+
+    std::string gzPath=file.path+".gz";
+    struct stat gzSt;
+    int fd=open(gzPath.data(),O_RDONLY);
+    if(fd>=0) {
+        if(fstat(fd,&gzSt)==0 && S_ISREG(gzSt.st_mode) && gzSt.st_mtime>=file.st.st_mtime &&
+           !readFile_(fd,gzSt.st_size,file.gzip)) {
+            file.gzip.clear();
+        }
+        close(fd);
+    }
+    if(file.gzip.empty() && compress && !compress_(file.data,file.gzip)) {
+        file.gzip.clear();
+    }
+    if(file.gzip.size()>=file.data.size()*9/10) {
+        file.gzip.clear();
+        return;
+    }
+    // 同一资源的不同编码是不同的表示，强 ETag 不能相同
+    file.gzipEtag=file.etag.substr(0,file.etag.size()-1)+"-gz\"";
+}
+
+bool FileCache::readFile_(int fd,size_t size,std::string& data)
+{
+    data.resize(size);
+    size_t done=0;
+    while(done<size) {
+        ssize_t len=read(fd,&data[done],size-done);
+        if(len<0 && errno==EINTR) continue;
+        if(len<=0) break;
+        done+=len;
+    }
+    return done==size;
+}
+
+/* 生成 gzip 格式（windowBits 加 16），启动时一次性完成，用最高压缩级别 */
+bool FileCache::compress_(const std::string& src,std::string& dst)
+{
+    z_stream zs;
+    memset(&zs,0,sizeof(zs));
+    if(deflateInit2(&zs,Z_BEST_COMPRESSION,Z_DEFLATED,15+16,9,Z_DEFAULT_STRATEGY)!=Z_OK) return false;
+    dst.resize(deflateBound(&zs,src.size())+32);
+    zs.next_in=reinterpret_cast<Bytef*>(const_cast<char*>(src.data()));
+    zs.avail_in=src.size();
+    zs.next_out=reinterpret_cast<Bytef*>(&dst[0]);
+    zs.avail_out=dst.size();
+    int ret=deflate(&zs,Z_FINISH);
+    dst.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret==Z_STREAM_END;
+}
+
+/* 插入到表头，同路径的旧条目被替换，超出分片容量时从表尾淘汰 */
+void FileCache::insert_(Shard& shard,const FilePtr& file)
+{
+    size_t limit=capacity_/SHARDS;
+    size_t size=file->data.size()+file->gzip.size();
+    if(size>limit) return;
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    auto it=shard.index.find(file->path);
+    if(it!=shard.index.end()) {
+        size_t old=(*it->second)->data.size()+(*it->second)->gzip.size();
+        shard.bytes-=old;
+        bytes_-=old;
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+    shard.lru.push_front(file);
+    shard.index[file->path]=shard.lru.begin();
+    shard.bytes+=size;
+    bytes_+=size;
+    while(shard.bytes>limit) {
+        const FilePtr& victim=shard.lru.back();
+        size_t victimSize=victim->data.size()+victim->gzip.size();
+        shard.bytes-=victimSize;
+        bytes_-=victimSize;
+        shard.index.erase(victim->path);
+        shard.lru.pop_back();
+    }
+}
+
+/* 只删除仍然是 file 的条目，其他线程可能已经换上了新加载的版本 */
+void FileCache::erase_(Shard& shard,const FilePtr& file)
+{
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    auto it=shard.index.find(file->path);
+    if(it==shard.index.end() || *it->second!=file) return;
+    size_t size=file->data.size()+file->gzip.size();
+    shard.bytes-=size;
+    bytes_-=size;
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+}
+
+bool FileCache::sameFile(const struct stat& a,const struct stat& b)
+{
+    return a.st_dev==b.st_dev && a.st_ino==b.st_ino && a.st_size==b.st_size &&
+           a.st_mode==b.st_mode && a.st_mtim.tv_sec==b.st_mtim.tv_sec &&
+           a.st_mtim.tv_nsec==b.st_mtim.tv_nsec;
+}
@@ -0,0 +1,87 @@
+// encode UTF-8
+
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/stat.h> //stat
+
+/* 缓存的静态文件：文件内容和预先算好的元数据
+条目创建后只读，通过 shared_ptr 在多个响应之间共享，响应发送期间持有引用，淘汰不会影响正在发送的连接 */
+struct CachedFile {
+    std::string path;     //解析后的完整路径
+    std::string data;     //文件内容
+    std::string gzip;     //gzip 压缩后的内容，没有压缩版本时为空
+    struct stat st;       //加载时的 stat，用 inode/mtime/大小判断文件是否变化
+    std::string mime;     //Content-type
+    std::string etag;     //由 inode/大小/mtime 生成的强 ETag
+    std::string gzipEtag; //压缩版本的 ETag，与原文件的不同
+    std::string lastModified; //Last-Modified 的 HTTP 日期
+    std::string headers;     //预先生成的文件相关响应头
+    std::string gzipHeaders; //发送压缩版本时的响应头
+};
+typedef std::shared_ptr<const CachedFile> FilePtr;
+
+/* 分片的静态文件缓存
+按路径哈希分到若干分片，每个分片一把锁、一个 LRU 链表，总大小有上限；
+文件的 stat 由网站目录索引提供，命中时比对 inode/mtime/大小，变化了就重新加载 */
+class FileCache {
+public:
+    static const int SHARDS = 16;
+    static const size_t DEFAULT_CAPACITY = 64 * 1024 * 1024; //总字节数上限
+    static const size_t DEFAULT_MAX_FILE = 1024 * 1024;      //超过此大小的文件不缓存
+
+    static FileCache& instance();
+
+    void setLimits(size_t capacity, size_t maxFile);
+
+    // 取与 st 一致的缓存条目，没有时尝试加载，文件不可缓存时返回空
+    FilePtr get(const std::string& path, const struct stat& st);
+
+    // 由索引在启动和文件变化时调用：读入文件，并为文本类文件生成 gzip 版本；
+    // 请求路径上加载的文件只使用已有的 .gz 文件，不做压缩
+    void preload(const std::string& path, const struct stat& st);
+    // 文件已删除，丢掉缓存条目
+    void remove(const std::string& path);
+
+    // 当前缓存的总字节数
+    size_t bytes() const {return bytes_;}
+
+    // inode、大小、权限和修改时间都相同时认为是同一个文件的同一版本
+    static bool sameFile(const struct stat& a, const struct stat& b);
+
+private:
+    FileCache();
+
+    struct Shard {
+        std::mutex mtx;
+        std::list<FilePtr> lru;  //表头最近使用
+        std::unordered_map<std::string, std::list<FilePtr>::iterator> index;
+        size_t bytes = 0;
+    };
+
+    Shard& shard_(const std::string& path);
+    FilePtr load_(const std::string& path, const struct stat& st, bool compress=false);
+    void loadGzip_(CachedFile& file, bool compress);
+    static bool readFile_(int fd, size_t size, std::string& data);
+    static bool compress_(const std::string& src, std::string& dst);
+    void insert_(Shard& shard, const FilePtr& file);
+    void erase_(Shard& shard, const FilePtr& file);
+    bool cacheable_(const struct stat& st) const;
+
+    size_t capacity_;
+    size_t maxFile_;
+    std::atomic<size_t> bytes_;
+    Shard shards_[SHARDS];
+
+    static const size_t MIN_GZIP_SIZE = 256;  //太小的文件压缩后收益不大
+    static const std::unordered_set<std::string> GZIP_SUFFIX; //值得压缩的后缀名
+};
+
+#endif //FILE_CACHE_H
@@ -7,6 +7,7 @@ int main() {
     /* 守护进程 后台运行 */
     //daemon(1, 0); 
 
+    /* 端口 ET模式 timeoutMs 优雅退出 线程数 [多Reactor模式] [io_uring后端] [时间轮定时器] [sendfile发送] */
     WebServer server(1316, 3, 60000, false, 4);            
     server.Start();
 } 
\ No newline at end of file
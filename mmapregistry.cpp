@@ -0,0 +1,85 @@
+// encode UTF-8
+
+#include "mmapregistry.h"
+#include "filecache.h"
+
+#include <fcntl.h>    //open
+#include <unistd.h>   //close
+#include <sys/mman.h> //mmap,munmap,madvise
+
+MappedFile::~MappedFile()
+{
+    if(addr) munmap(addr,size);
+}
+
+MmapRegistry& MmapRegistry::instance()
+{
+    static MmapRegistry registry;
+    return registry;
+}
+
+MappingPtr MmapRegistry::get(const std::string& path,const struct stat& st)
+{
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        auto it=index_.find(path);
+        if(it!=index_.end()) {
+            if(FileCache::sameFile(st,(*it->second)->st)) {
+                lru_.splice(lru_.begin(),lru_,it->second);
+                return *it->second;
+            }
+            lru_.erase(it->second);
+            index_.erase(it);
+        }
+    }
+    // 映射放在锁外，同一文件并发映射时后来的替换先来的，先来的由持有者用完后解除
+    MappingPtr mapping=map_(path,st);
+    if(!mapping) return nullptr;
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto it=index_.find(path);
+    if(it!=index_.end()) {
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+    lru_.push_front(mapping);
+    index_[path]=lru_.begin();
+    while(lru_.size()>MAX_MAPPINGS) {
+        index_.erase(lru_.back()->path);
+        lru_.pop_back();
+    }
+    return mapping;
+}
+
+void MmapRegistry::remove(const std::string& path)
+{
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto it=index_.find(path);
+    if(it==index_.end()) return;
+    lru_.erase(it->second);
+    index_.erase(it);
+}
+
+/* 以打开后的 fstat 为准，与 st 不一致说明文件刚被改过，这次不映射
+较小的文件用 MAP_POPULATE 一次建好页表，大文件按顺序读提示内核预读 */
+MappingPtr MmapRegistry::map_(const std::string& path,const struct stat& st)
+{
+    if(st.st_size<=0) return nullptr;
+    int fd=open(path.data(),O_RDONLY);
+    if(fd<0) return nullptr;
+    std::shared_ptr<MappedFile> mapping=std::make_shared<MappedFile>();
+    if(fstat(fd,&mapping->st)<0 || !FileCache::sameFile(st,mapping->st)) {
+        close(fd);
+        return nullptr;
+    }
+    size_t size=mapping->st.st_size;
+    int flags=MAP_SHARED;
+    if(size<=POPULATE_LIMIT) flags|=MAP_POPULATE;
+    void* addr=mmap(0,size,PROT_READ,flags,fd,0);
+    close(fd);
+    if(addr==MAP_FAILED) return nullptr;
+    if(size>POPULATE_LIMIT) madvise(addr,size,MADV_SEQUENTIAL);
+    mapping->path=path;
+    mapping->addr=static_cast<char*>(addr);
+    mapping->size=size;
+    return mapping;
+}
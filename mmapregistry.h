@@ -0,0 +1,51 @@
+// encode UTF-8
+
+#ifndef MMAP_REGISTRY_H
+#define MMAP_REGISTRY_H
+
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <sys/stat.h> //stat
+
+/* 一个文件的只读映射，最后一个引用释放时才解除映射 */
+struct MappedFile {
+    MappedFile():addr(nullptr),size(0) {}
+    ~MappedFile();
+
+    std::string path;
+    struct stat st;   //映射时的 stat，用来判断文件是否变化
+    char* addr;
+    size_t size;
+};
+typedef std::shared_ptr<const MappedFile> MappingPtr;
+
+/* 共享的文件映射表
+不进文件缓存的大文件每个文件只映射一次，各连接通过引用计数借用其中的一段，
+不再每个响应 mmap/munmap 一次；表中最多保留 MAX_MAPPINGS 个映射，按 LRU 淘汰，
+文件变化（stat 不一致）或被删除时作废，正在发送的连接持有的旧映射等发送完才解除 */
+class MmapRegistry {
+public:
+    static const size_t MAX_MAPPINGS = 256;
+    static const size_t POPULATE_LIMIT = 8 * 1024 * 1024; //不超过此大小的文件映射时预读全部页面
+
+    static MmapRegistry& instance();
+
+    // 取与 st 一致的映射，没有时新建，失败返回空
+    MappingPtr get(const std::string& path, const struct stat& st);
+    // 文件已变化或删除，丢掉表中的映射
+    void remove(const std::string& path);
+
+private:
+    MmapRegistry() = default;
+
+    static MappingPtr map_(const std::string& path, const struct stat& st);
+
+    std::mutex mtx_;
+    std::list<MappingPtr> lru_;  //表头最近使用
+    std::unordered_map<std::string, std::list<MappingPtr>::iterator> index_;
+};
+
+#endif //MMAP_REGISTRY_H
@@ -0,0 +1,267 @@
+// encode UTF-8
+
+#include "reactor.h"
+
+Reactor::Reactor(int listenFd,uint32_t listenEvent,uint32_t connectionEvent,
+                 int timeoutMS,ThreadPool* threadpool,bool useUring,bool useTimeWheel):
+    listenFd_(listenFd),timeoutMS_(timeoutMS),isValid_(true),isClose_(false),
+    listenEvent_(listenEvent),connectionEvent_(connectionEvent),threadpool_(threadpool),
+    epoller_(Epoller::create(useUring)),users_(tableSize_())
+{
+    if(useTimeWheel) wheel_.reset(new TimeWheel());
+    else timer_.reset(new TimerManager());
+
+    // 向epoll注册监听套接字连接事件
+    if(!epoller_->addFd(listenFd_, listenEvent_ | EPOLLIN)) {
+        //printf("Add listen error!\n");
+        isValid_=false;
+    }
+}
+
+Reactor::~Reactor()
+{
+    isClose_=true;
+    close(listenFd_);
+}
+
+size_t Reactor::tableSize_()
+{
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) < 0 || limit.rlim_cur == RLIM_INFINITY
+       || limit.rlim_cur > static_cast<rlim_t>(MAX_FD)) {
+        return MAX_FD;
+    }
+    return limit.rlim_cur;
+}
+
+void Reactor::stop()
+{
+    isClose_=true;
+}
+
+/* epoll循环监听事件，根据事件类型调用相应方法 */
+// 延迟计算思想，方法及参数会被打包放到线程池的任务队列中
+void Reactor::loop()
+{
+    int timeMS=-1;//epoll wait timeout==-1就是无事件一直阻塞
+    while(!isClose_)
+    {
+        // 返回下一个计时器超时的时间
+        if(timeoutMS_>0)
+        {
+            timeMS=wheel_?wheel_->getNextHandle():timer_->getNextHandle();
+        }
+        /* 利用 epoll 的 time_wait 实现定时功能 */
+        // 在计时器超时前唤醒一次 epoll ，判断是否有新事件到达
+        // 如果没有新事件，下次调用 getNextHandle 时，会将超时的堆顶计时器删除
+        int eventCnt=epoller_->wait(timeMS);
+        // 遍历事件表
+        for(int i=0;i<eventCnt;++i)
+        {
+            // 事件套接字 事件内容
+            int fd=epoller_->getEventFd(i);
+            uint32_t events=epoller_->getEvents(i);
+
+            // 监听套接字只有连接事件
+            if(fd==listenFd_)
+            {
+                handleListen_();
+                //std::cout<<fd<<" is listening!"<<std::endl;
+                continue;
+            }
+
+            /* 连接套接字几种事件 */
+            if(fd < 0 || static_cast<size_t>(fd) >= users_.size() || !users_[fd].conn) {
+                continue;
+            }
+            HTTPconnection* client = users_[fd].conn.get();
+            uint32_t gen = users_[fd].gen;
+            // 对端关闭连接
+            if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                closeConn_(client, gen);
+            }
+            // 读事件
+            else if(events & EPOLLIN) {
+                handleRead_(client, gen);
+                //std::cout<<fd<<" reading end!"<<std::endl;
+            }
+            // 写事件
+            else if(events & EPOLLOUT) {
+                handleWrite_(client, gen);
+            }
+            else {
+                std::cout<<"Unexpected event"<<std::endl;
+            }
+        }
+    }
+}
+
+/* 发送错误 */
+void Reactor::sendError_(int fd, const char* info)
+{
+    assert(fd>0);
+    int ret=send(fd,info,strlen(info),0);
+    if(ret<0)
+    {
+        //std::cout<<"send error to client"<<fd<<" error!"<<std::endl;
+    }
+    close(fd);
+}
+
+/* 关闭连接套接字，并从epoll事件表中删除相应事件 */
+// gen 对不上说明连接已经被关闭（可能 fd 已被新连接复用），什么也不做
+void Reactor::closeConn_(HTTPconnection* client, uint32_t gen)
+{
+    assert(client);
+    //std::cout<<"client"<<client->getFd()<<" quit!"<<std::endl;
+    if(!users_[client->getFd()].gen.compare_exchange_strong(gen, gen + 1)) {
+        return;
+    }
+    epoller_->delFd(client->getFd());
+    client->closeHTTPConn();
+}
+
+/* 为连接注册事件和设置计时器 */
+void Reactor::addClientConnection(int fd, sockaddr_in addr)
+{
+    assert(fd>0 && static_cast<size_t>(fd)<users_.size());
+    // users 按套接字下标直接取槽，槽里的 HTTPconnection 对象随 fd 复用
+    // 将 fd 和连接地址传入,初始化 HttpConnect 对象，用 client 表示
+    ConnSlot& slot=users_[fd];
+    if(!slot.conn) slot.conn.reset(new HTTPconnection());
+    HTTPconnection* client=slot.conn.get();
+    client->initHTTPConn(fd,addr);
+    uint32_t gen=slot.gen;
+    // 添加计时器，到期关闭连接
+    if(timeoutMS_>0)
+    {
+        if(wheel_) wheel_->add(client->timerNode(),timeoutMS_,std::bind(&Reactor::closeConn_,this,client,gen));
+        else timer_->addTimer(fd,timeoutMS_,std::bind(&Reactor::closeConn_,this,client,gen));
+    }
+    epoller_->addFd(fd,EPOLLIN | connectionEvent_);
+    // 套接字设置非阻塞
+    setFdNonblock(fd);
+}
+
+/* 新建连接套接字，ET模式会一次将连接队列读完 */
+void Reactor::handleListen_() {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    do {
+        int fd = accept(listenFd_, (struct sockaddr *)&addr, &len);
+        if(fd <= 0) { return;}
+        else if(HTTPconnection::userCount >= MAX_FD || static_cast<size_t>(fd) >= users_.size()) {
+            sendError_(fd, "Server busy!");
+            //std::cout<<"Clients is full!"<<std::endl;
+            return;
+        }
+        addClientConnection(fd, addr);
+    } while(listenEvent_ & EPOLLET);
+}
+
+/* 将读函数投递到线程池，结果无人关心，用 post 免去 future 和堆分配；没有线程池时直接在本线程读 */
+void Reactor::handleRead_(HTTPconnection* client, uint32_t gen) {
+    assert(client);
+    extentTime_(client);
+    if(!threadpool_) {
+        onRead_(client, gen);
+        return;
+    }
+    threadpool_->post([this, client, gen]() { onRead_(client, gen); });
+}
+
+/* 将写函数投递到线程池；没有线程池时直接在本线程写 */
+void Reactor::handleWrite_(HTTPconnection* client, uint32_t gen)
+{
+    assert(client);
+    extentTime_(client);
+    if(!threadpool_) {
+        onWrite_(client, gen);
+        return;
+    }
+    threadpool_->post([this, client, gen]() { onWrite_(client, gen); });
+}
+
+/* 重置计时器 */
+void Reactor::extentTime_(HTTPconnection* client)
+{
+    assert(client);
+    if(timeoutMS_>0)
+    {
+        // 时间轮只改写结点的到期时间，几乎没有开销
+        if(wheel_) wheel_->refresh(client->timerNode(),timeoutMS_);
+        else timer_->update(client->getFd(),timeoutMS_);
+    }
+}
+
+/* 读函数：先接收再处理 */
+void Reactor::onRead_(HTTPconnection* client, uint32_t gen)
+{
+    assert(client);
+    // 任务排队期间连接已被关闭
+    if(users_[client->getFd()].gen != gen) return;
+    int ret = -1;
+    int readErrno = 0;
+    ret = client->readBuffer(&readErrno);
+    //std::cout<<ret<<std::endl;
+
+    // 客户端发送EOF
+    if(ret <= 0 && readErrno != EAGAIN) {
+        //std::cout<<"do not read data!"<<std::endl;
+        closeConn_(client, gen);
+        return;
+    }
+    onProcess_(client);
+}
+
+/* 处理函数：判断读入的请求报文是否完整，决定是继续监听读还是监听写 */
+// 如果请求不完整，继续读，如果请求完整，则根据请求内容生成相应的响应报文，并发送
+// oneshot需要再次监听
+void Reactor::onProcess_(HTTPconnection* client)
+{
+    if(client->handleHTTPConn()) {
+        epoller_->modFd(client->getFd(), connectionEvent_ | EPOLLOUT);
+    }
+    else {
+        epoller_->modFd(client->getFd(), connectionEvent_ | EPOLLIN);
+    }
+}
+
+/* 写函数：发送响应报文，大文件需要分多次发送 */
+// 由于设置了oneshot，需要再次监听读
+void Reactor::onWrite_(HTTPconnection* client, uint32_t gen) {
+    assert(client);
+    if(users_[client->getFd()].gen != gen) return;
+    int ret = -1;
+    int writeErrno = 0;
+    ret = client->writeBuffer(&writeErrno);
+    if(client->writeBytes() == 0) {
+        /* 传输完成 */
+        if(client->isKeepAlive()) {
+            onProcess_(client);
+            return;
+        }
+    }
+    // 水平触发时每次只发送一部分，文件体也可能要单独一次 sendfile，剩下的等下次可写
+    else if(ret > 0) {
+        epoller_->modFd(client->getFd(), connectionEvent_ | EPOLLOUT);
+        return;
+    }
+    // 发送失败
+    else if(ret < 0) {
+        // 缓存满导致的，继续监听写
+        if(writeErrno == EAGAIN) {
+            /* 继续传输 */
+            epoller_->modFd(client->getFd(), connectionEvent_ | EPOLLOUT);
+            return;
+        }
+    }
+    // 其他原因导致，关闭连接
+    closeConn_(client, gen);
+}
+
+/* 套接字设置非阻塞 */
+int Reactor::setFdNonblock(int fd) {
+    assert(fd > 0);
+    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFD, 0) | O_NONBLOCK);
+}
@@ -0,0 +1,79 @@
+// encode UTF-8
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <vector>
+#include <atomic>
+#include <fcntl.h>       // fcntl()
+#include <unistd.h>      // close()
+#include <assert.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/resource.h> //getrlimit()
+
+#include "epoller.h"
+#include "timer.h"
+#include "timewheel.h"
+#include "threadpool.h"
+#include "HTTPconnection.h"
+
+/* 一个事件循环：持有自己的 Epoller、定时器、监听套接字和连接表
+单Reactor模式下只有一个实例，读写任务交给线程池处理；
+多Reactor模式下每个线程各持有一个实例（threadpool 为空），请求在本线程内从头处理到尾 */
+class Reactor {
+public:
+    Reactor(int listenFd,uint32_t listenEvent,uint32_t connectionEvent,
+            int timeoutMS,ThreadPool* threadpool,bool useUring=false,bool useTimeWheel=false);
+    ~Reactor();
+
+    bool isValid() const {return isValid_;}
+    void loop();  //事件循环，直到 stop 被调用
+    void stop();
+
+    static const int MAX_FD = 65536;
+    static int setFdNonblock(int fd);
+
+private:
+    /* 连接表的一个槽，按 fd 直接下标访问
+    连接对象第一次用到时创建，之后随 fd 复用；gen 在每次关闭时加一，
+    投递到线程池的任务和定时器回调都带着创建时的 gen，对不上说明 fd 已被关闭或复用，直接丢弃 */
+    struct ConnSlot {
+        ConnSlot():gen(0) {}
+        std::unique_ptr<HTTPconnection> conn;
+        std::atomic<uint32_t> gen;
+    };
+
+    static size_t tableSize_();  //连接表大小：RLIMIT_NOFILE，不超过 MAX_FD
+
+    void addClientConnection(int fd, sockaddr_in addr); //添加一个HTTP连接
+    void closeConn_(HTTPconnection* client, uint32_t gen); //关闭一个HTTP连接
+
+    void handleListen_();
+    void handleWrite_(HTTPconnection* client, uint32_t gen);
+    void handleRead_(HTTPconnection* client, uint32_t gen);
+
+    void onRead_(HTTPconnection* client, uint32_t gen);
+    void onWrite_(HTTPconnection* client, uint32_t gen);
+    void onProcess_(HTTPconnection* client);
+
+    void sendError_(int fd, const char* info);
+    void extentTime_(HTTPconnection* client);
+
+    int listenFd_;
+    int timeoutMS_;  /* 毫秒MS,定时器的默认过期时间 */
+    bool isValid_;
+    std::atomic<bool> isClose_;
+
+    uint32_t listenEvent_;
+    uint32_t connectionEvent_;
+
+    ThreadPool* threadpool_; //不持有，为空时在本线程内直接读写
+    std::unique_ptr<TimerManager>timer_;  //小根堆定时器
+    std::unique_ptr<TimeWheel>wheel_;     //时间轮定时器，和 timer_ 二选一
+    std::unique_ptr<Epoller> epoller_;
+    std::vector<ConnSlot> users_;  //预分配，运行中不会扩容
+};
+
+#endif //REACTOR_H
@@ -0,0 +1,276 @@
+// encode UTF-8
+
+#include "resourceindex.h"
+#include "HTTPresponse.h"
+#include "filecache.h"
+#include "mmapregistry.h"
+
+#include <dirent.h>      //opendir,readdir
+#include <poll.h>        //poll
+#include <unistd.h>      //read,close
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+
+const std::unordered_set<std::string> ResourceIndex::DEFAULT_HTML{
+            "/index", "/welcome", "/video", "/picture"};
+
+static const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+                                   IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR;
+
+ResourceIndex& ResourceIndex::instance()
+{
+    static ResourceIndex index;
+    return index;
+}
+
+ResourceIndex::ResourceIndex():inotifyFd_(-1),stopFd_(-1),generation_(0)
+{
+}
+
+ResourceIndex::~ResourceIndex()
+{
+    close();
+}
+
+bool ResourceIndex::open(const std::string& root)
+{
+    close();
+    root_=root;
+    while(root_.size()>1 && root_.back()=='/') root_.pop_back();
+    inotifyFd_=inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stopFd_=eventfd(0,EFD_NONBLOCK | EFD_CLOEXEC);
+    if(inotifyFd_<0 || stopFd_<0) {
+        close();
+        return false;
+    }
+    // 先挂监视再扫描，扫描期间发生的变化不会漏掉
+    watch_(root_,"");
+    scan_(root_,"");
+    watcher_=std::thread(&ResourceIndex::loop_,this);
+    return true;
+}
+
+void ResourceIndex::close()
+{
+    if(watcher_.joinable()) {
+        uint64_t one=1;
+        ssize_t ret=write(stopFd_,&one,sizeof(one));
+        (void)ret;
+        watcher_.join();
+    }
+    if(inotifyFd_>=0) ::close(inotifyFd_);
+    if(stopFd_>=0) ::close(stopFd_);
+    inotifyFd_=stopFd_=-1;
+    dirs_.clear();
+    for(auto& shard:shards_) {
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        shard.entries.clear();
+    }
+    generation_.fetch_add(1,std::memory_order_release);
+}
+
+ResourcePtr ResourceIndex::find(StrView url) const
+{
+    size_t query=url.find('?');
+    if(query!=StrView::npos) url=url.substr(0,query);
+    std::string key(url.data(),url.size());
+    const Shard& shard=shard_(key);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    auto it=shard.entries.find(key);
+    return it==shard.entries.end()?nullptr:it->second;
+}
+
+ResourceIndex::Shard& ResourceIndex::shard_(const std::string& key) const
+{
+    return shards_[std::hash<std::string>()(key)%SHARDS];
+}
+
+/* 递归扫描目录，隐藏文件不登记 */
+void ResourceIndex::scan_(const std::string& dir,const std::string& url)
+{
+    DIR* dp=opendir(dir.data());
+    if(!dp) return;
+    struct dirent* ent;
+    while((ent=readdir(dp))!=nullptr) {
+        if(ent->d_name[0]=='.') continue;
+        std::string file=dir+"/"+ent->d_name;
+        std::string childUrl=url+"/"+ent->d_name;
+        struct stat st;
+        if(stat(file.data(),&st)<0) continue;
+        if(S_ISDIR(st.st_mode)) {
+            watch_(file,childUrl);
+            scan_(file,childUrl);
+        }
+        else {
+            update_(file,childUrl);
+        }
+    }
+    closedir(dp);
+}
+
+/* 重新 stat 一个文件，存在就登记（同时预热文件缓存），不存在或不是普通文件就删掉 */
+void ResourceIndex::update_(const std::string& file,const std::string& url)
+{
+    struct stat st;
+    if(stat(file.data(),&st)<0 || !S_ISREG(st.st_mode)) {
+        remove_(url);
+        return;
+    }
+    std::shared_ptr<Resource> res=std::make_shared<Resource>();
+    res->url=url;
+    res->file=file;
+    res->st=st;
+    res->mime=HTTPresponse::fileType(file);
+    res->etag=HTTPresponse::makeETag(st);
+    res->lastModified=HTTPresponse::httpDate(st.st_mtime);
+    put_(res);
+    // 压缩版本在这里生成，不放到请求路径上；旧的映射作废
+    FileCache::instance().preload(file,st);
+    MmapRegistry::instance().remove(file);
+}
+
+/* 登记文件本身和它的别名，真实文件优先于同名的别名 */
+void ResourceIndex::put_(const ResourcePtr& res)
+{
+    {
+        Shard& shard=shard_(res->url);
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        shard.entries[res->url]=res;
+    }
+    for(const std::string& alias:aliases_(res->url)) {
+        Shard& shard=shard_(alias);
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        auto it=shard.entries.find(alias);
+        if(it==shard.entries.end() || it->second->url!=alias) {
+            shard.entries[alias]=res;
+        }
+    }
+    generation_.fetch_add(1,std::memory_order_release);
+}
+
+void ResourceIndex::remove_(const std::string& url)
+{
+    std::vector<std::string> keys=aliases_(url);
+    keys.push_back(url);
+    std::string file;
+    for(const std::string& key:keys) {
+        Shard& shard=shard_(key);
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        auto it=shard.entries.find(key);
+        if(it!=shard.entries.end() && it->second->url==url) {
+            file=it->second->file;
+            shard.entries.erase(it);
+        }
+    }
+    if(!file.empty()) {
+        generation_.fetch_add(1,std::memory_order_release);
+        FileCache::instance().remove(file);
+        MmapRegistry::instance().remove(file);
+    }
+}
+
+/* 目录被删除或移走，去掉其下所有的登记 */
+void ResourceIndex::removeDir_(const std::string& url)
+{
+    std::string prefix=url+"/";
+    std::vector<std::string> files;
+    for(auto& shard:shards_) {
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        for(auto it=shard.entries.begin();it!=shard.entries.end();) {
+            if(StrView(it->second->url).startsWith(prefix)) {
+                if(it->first==it->second->url) files.push_back(it->second->file);
+                it=shard.entries.erase(it);
+            }
+            else ++it;
+        }
+    }
+    generation_.fetch_add(1,std::memory_order_release);
+    for(const std::string& file:files) {
+        FileCache::instance().remove(file);
+        MmapRegistry::instance().remove(file);
+    }
+    for(auto it=dirs_.begin();it!=dirs_.end();) {
+        if(it->second.url==url || StrView(it->second.url).startsWith(prefix)) {
+            inotify_rm_watch(inotifyFd_,it->first);
+            it=dirs_.erase(it);
+        }
+        else ++it;
+    }
+}
+
+void ResourceIndex::watch_(const std::string& dir,const std::string& url)
+{
+    int wd=inotify_add_watch(inotifyFd_,dir.data(),WATCH_MASK);
+    if(wd>=0) dirs_[wd]=WatchDir{dir,url};
+}
+
+/* DEFAULT_HTML 中的页面可以省略 .html；/a/index.html 还有 /a/，根目录下为 / */
+std::vector<std::string> ResourceIndex::aliases_(const std::string& url)
+{
+    std::vector<std::string> aliases;
+    static const std::string HTML=".html";
+    static const std::string INDEX="/index.html";
+    if(url.size()>HTML.size() && url.compare(url.size()-HTML.size(),HTML.size(),HTML)==0 &&
+       DEFAULT_HTML.count(url.substr(0,url.size()-HTML.size()))) {
+        aliases.push_back(url.substr(0,url.size()-HTML.size()));
+    }
+    if(url.size()>=INDEX.size() && url.compare(url.size()-INDEX.size(),INDEX.size(),INDEX)==0) {
+        aliases.push_back(url.substr(0,url.size()-INDEX.size()+1));
+    }
+    return aliases;
+}
+
+void ResourceIndex::loop_()
+{
+    struct pollfd fds[2];
+    fds[0].fd=inotifyFd_;
+    fds[0].events=POLLIN;
+    fds[1].fd=stopFd_;
+    fds[1].events=POLLIN;
+    alignas(struct inotify_event) char buf[4096];
+    while(true) {
+        if(poll(fds,2,-1)<0) {
+            if(errno==EINTR) continue;
+            break;
+        }
+        if(fds[1].revents) break;
+        ssize_t len;
+        while((len=read(inotifyFd_,buf,sizeof(buf)))>0) {
+            for(char* p=buf;p<buf+len;) {
+                struct inotify_event* ev=reinterpret_cast<struct inotify_event*>(p);
+                handleEvent_(ev->wd,ev->mask,ev->len?ev->name:"");
+                p+=sizeof(struct inotify_event)+ev->len;
+            }
+        }
+    }
+}
+
+void ResourceIndex::handleEvent_(int wd,uint32_t mask,const char* name)
+{
+    if(mask & IN_Q_OVERFLOW) {
+        // 事件丢失，整个重新扫描一遍
+        scan_(root_,"");
+        return;
+    }
+    auto it=dirs_.find(wd);
+    if(it==dirs_.end()) return;
+    WatchDir dir=it->second;
+    if(mask & (IN_DELETE_SELF | IN_IGNORED)) {
+        removeDir_(dir.url);
+        return;
+    }
+    if(name[0]=='\0' || name[0]=='.') return;
+    std::string file=dir.file+"/"+name;
+    std::string url=dir.url+"/"+name;
+    if(mask & IN_ISDIR) {
+        if(mask & (IN_CREATE | IN_MOVED_TO)) {
+            watch_(file,url);
+            scan_(file,url);
+        }
+        else if(mask & (IN_DELETE | IN_MOVED_FROM)) {
+            removeDir_(url);
+        }
+        return;
+    }
+    update_(file,url);
+}
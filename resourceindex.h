@@ -0,0 +1,85 @@
+// encode UTF-8
+
+#ifndef RESOURCE_INDEX_H
+#define RESOURCE_INDEX_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/stat.h> //stat
+
+#include "strview.h"
+
+/* 网站目录中的一个文件：URL、完整路径和启动时（或文件变化时）算好的元数据 */
+struct Resource {
+    std::string url;          //规范的 URL 路径，如 /index.html
+    std::string file;         //完整的文件路径
+    struct stat st;
+    std::string mime;
+    std::string etag;
+    std::string lastModified;
+};
+typedef std::shared_ptr<const Resource> ResourcePtr;
+
+/* 网站目录索引
+启动时扫描整个目录，建立 URL 到文件元数据的映射，请求时只查表，不再拼接路径和 stat；
+目录中的变化由后台线程通过 inotify 增量更新。
+DEFAULT_HTML 中的页面同时以不带 .html 的路径登记，目录下的 index.html 同时以 /dir/ 登记；
+不在索引里的路径（包括带 .. 的路径）一律找不到，不会访问到网站目录之外的文件 */
+class ResourceIndex {
+public:
+    static const int SHARDS = 16;
+
+    static ResourceIndex& instance();
+
+    // 扫描 root 并启动监视线程，失败返回 false
+    bool open(const std::string& root);
+    void close();
+
+    // 按 URL 查找，忽略 ? 之后的查询串，找不到返回空
+    ResourcePtr find(StrView url) const;
+
+    // 索引每次变化都加一，依赖索引内容的预生成数据据此判断是否过期
+    uint64_t generation() const {return generation_.load(std::memory_order_acquire);}
+
+private:
+    ResourceIndex();
+    ~ResourceIndex();
+
+    struct Shard {
+        mutable std::mutex mtx;
+        std::unordered_map<std::string, ResourcePtr> entries;
+    };
+    struct WatchDir {
+        std::string file;
+        std::string url;
+    };
+
+    Shard& shard_(const std::string& key) const;
+    void scan_(const std::string& dir, const std::string& url);
+    void update_(const std::string& file, const std::string& url);
+    void put_(const ResourcePtr& res);
+    void remove_(const std::string& url);
+    void removeDir_(const std::string& url);
+    void watch_(const std::string& dir, const std::string& url);
+    void loop_();
+    void handleEvent_(int wd, uint32_t mask, const char* name);
+    static std::vector<std::string> aliases_(const std::string& url);
+
+    mutable Shard shards_[SHARDS];
+    std::string root_;
+    int inotifyFd_;
+    int stopFd_;        //eventfd，通知监视线程退出
+    std::thread watcher_;
+    std::atomic<uint64_t> generation_;
+    std::unordered_map<int, WatchDir> dirs_; //inotify 监视描述符到目录，只在监视线程中修改
+
+    static const std::unordered_set<std::string> DEFAULT_HTML; //可以省略 .html 访问的页面
+};
+
+#endif //RESOURCE_INDEX_H
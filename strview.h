@@ -0,0 +1,64 @@
+// encode UTF-8
+
+#ifndef STRVIEW_H
+#define STRVIEW_H
+
+#include <string>
+#include <cstring>
+#include <strings.h> //strncasecmp()
+
+/* 只读字符串视图，指向已有的内存（通常是连接的读缓冲区），不拷贝也不负责释放 */
+class StrView {
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    StrView():data_(nullptr),size_(0) {}
+    StrView(const char* data,size_t size):data_(data),size_(size) {}
+    StrView(const char* str):data_(str),size_(str?strlen(str):0) {}
+    StrView(const std::string& str):data_(str.data()),size_(str.size()) {}
+
+    const char* data() const {return data_;}
+    size_t size() const {return size_;}
+    bool empty() const {return size_==0;}
+    const char* begin() const {return data_;}
+    const char* end() const {return data_+size_;}
+    char operator[](size_t i) const {return data_[i];}
+
+    std::string toString() const {return std::string(data_,size_);}
+
+    StrView substr(size_t pos,size_t n=npos) const
+    {
+        if(pos>size_) pos=size_;
+        if(n>size_-pos) n=size_-pos;
+        return StrView(data_+pos,n);
+    }
+
+    size_t find(char ch,size_t pos=0) const
+    {
+        if(pos>=size_) return npos;
+        const void* p=memchr(data_+pos,ch,size_-pos);
+        return p?static_cast<const char*>(p)-data_:npos;
+    }
+
+    bool startsWith(StrView prefix) const
+    {
+        return size_>=prefix.size_ && (prefix.size_==0 || memcmp(data_,prefix.data_,prefix.size_)==0);
+    }
+
+    bool equalsIgnoreCase(StrView other) const
+    {
+        return size_==other.size_ && strncasecmp(data_,other.data_,size_)==0;
+    }
+
+    bool operator==(StrView other) const
+    {
+        return size_==other.size_ && (size_==0 || memcmp(data_,other.data_,size_)==0);
+    }
+    bool operator!=(StrView other) const {return !(*this==other);}
+
+private:
+    const char* data_;
+    size_t size_;
+};
+
+#endif //STRVIEW_H
@@ -7,43 +7,344 @@
 #include<condition_variable>
 #include<mutex>
 #include<vector>
-#include<queue>
+#include<deque>
+#include<atomic>
+#include<random>
 #include<future>
+#include<functional>
+#include<memory>
+#include<type_traits>
+#include<cstddef>
 
+/* 固定大小的任务槽
+小型可调用对象（如捕获 this 和连接指针的 lambda）直接构造在槽内，不再经过 std::function 和堆分配；
+放不下的对象退化为在堆上构造，槽内只保存指针 */
+class TaskSlot{
+public:
+    static const size_t CAPACITY=48;
+
+    template<typename F>
+    void emplace(F&& f){
+        typedef typename std::decay<F>::type Fn;
+        emplace_(std::forward<F>(f),std::integral_constant<bool,
+            sizeof(Fn)<=CAPACITY && alignof(Fn)<=alignof(std::max_align_t)>());
+    }
+
+    // 执行并析构槽内的对象，之后槽可以被归还
+    void run(){
+        invoke_(&storage_);
+        destroy_(&storage_);
+    }
+
+    TaskSlot* next; //空闲链表
+
+private:
+    template<typename F>
+    void emplace_(F&& f,std::true_type){
+        typedef typename std::decay<F>::type Fn;
+        new(&storage_) Fn(std::forward<F>(f));
+        invoke_=[](void* p){ (*static_cast<Fn*>(p))(); };
+        destroy_=[](void* p){ static_cast<Fn*>(p)->~Fn(); };
+    }
+
+    template<typename F>
+    void emplace_(F&& f,std::false_type){
+        typedef typename std::decay<F>::type Fn;
+        new(&storage_) Fn*(new Fn(std::forward<F>(f)));
+        invoke_=[](void* p){ (**static_cast<Fn**>(p))(); };
+        destroy_=[](void* p){ delete *static_cast<Fn**>(p); };
+    }
+
+    typename std::aligned_storage<CAPACITY,alignof(std::max_align_t)>::type storage_;
+    void (*invoke_)(void*);
+    void (*destroy_)(void*);
+};
+
+/* 任务槽的池化分配器
+每个线程持有一段本地空闲链表，空了从全局链表整批取，多了整批还回全局链表，
+全局链表也空时按块申请新槽，槽只增不减、循环使用 */
+class TaskSlotPool{
+public:
+    static TaskSlot* acquire(){
+        LocalCache& cache=local();
+        if(!cache.head) refill_(cache);
+        TaskSlot* slot=cache.head;
+        cache.head=slot->next;
+        --cache.count;
+        return slot;
+    }
+
+    static void release(TaskSlot* slot){
+        LocalCache& cache=local();
+        slot->next=cache.head;
+        cache.head=slot;
+        // 生产者和消费者往往不是同一个线程，本地积压过多时归还一批
+        if(++cache.count>=2*BATCH) spill_(cache);
+    }
+
+private:
+    static const size_t BATCH=64;
+
+    struct LocalCache{
+        TaskSlot* head;
+        size_t count;
+    };
+
+    struct Global{
+        std::mutex mtx;
+        TaskSlot* head=nullptr;
+        std::vector<std::unique_ptr<TaskSlot[]>> chunks;
+    };
+
+    static LocalCache& local(){
+        static thread_local LocalCache cache={nullptr,0};
+        return cache;
+    }
+
+    static Global& global(){
+        static Global g;
+        return g;
+    }
+
+    static void refill_(LocalCache& cache){
+        Global& g=global();
+        std::unique_lock<std::mutex>lk(g.mtx);
+        if(!g.head){
+            TaskSlot* chunk=new TaskSlot[BATCH];
+            g.chunks.emplace_back(chunk);
+            for(size_t i=0;i<BATCH;++i){
+                chunk[i].next=g.head;
+                g.head=&chunk[i];
+            }
+        }
+        while(g.head&&cache.count<BATCH){
+            TaskSlot* slot=g.head;
+            g.head=slot->next;
+            slot->next=cache.head;
+            cache.head=slot;
+            ++cache.count;
+        }
+    }
+
+    static void spill_(LocalCache& cache){
+        TaskSlot* first=cache.head;
+        TaskSlot* last=first;
+        for(size_t i=1;i<BATCH;++i) last=last->next;
+        cache.head=last->next;
+        cache.count-=BATCH;
+        Global& g=global();
+        std::unique_lock<std::mutex>lk(g.mtx);
+        last->next=g.head;
+        g.head=first;
+    }
+};
+
+/* 工作窃取线程池
+每个工作线程有一个无锁的 Chase-Lev 双端队列：拥有者在队尾压入和弹出，其他线程从队头窃取；
+工作线程内提交的任务进入自己的队列，外部线程提交的任务轮流投递到各线程的收件箱（每个线程一把锁），
+空闲线程先随机选择其他线程窃取，仍然没有任务时才挂起等待唤醒。
+任务以 TaskSlot 的形式在队列中流转，post 提交不产生堆分配 */
 class ThreadPool{
 private:
-    bool m_stop;
+    typedef TaskSlot Task;
+
+    /* Chase-Lev 双端队列，只保存任务指针 */
+    class WorkDeque{
+    public:
+        WorkDeque():m_top(0),m_bottom(0),m_array(new Array(64)){}
+        ~WorkDeque(){
+            delete m_array.load(std::memory_order_relaxed);
+            for(auto array:m_garbage) delete array;
+        }
+
+        // 只能由拥有者调用
+        void push(Task* task){
+            int64_t b=m_bottom.load(std::memory_order_relaxed);
+            int64_t t=m_top.load(std::memory_order_acquire);
+            Array* a=m_array.load(std::memory_order_relaxed);
+            if(b-t>a->size-1){
+                // 扩容，旧数组可能仍在被窃取者读取，析构时再释放
+                Array* bigger=new Array(a->size*2);
+                for(int64_t i=t;i<b;++i) bigger->put(i,a->get(i));
+                m_garbage.push_back(a);
+                a=bigger;
+                m_array.store(a,std::memory_order_release);
+            }
+            a->put(b,task);
+            std::atomic_thread_fence(std::memory_order_release);
+            m_bottom.store(b+1,std::memory_order_relaxed);
+        }
+
+        // 只能由拥有者调用，从队尾取
+        Task* pop(){
+            int64_t b=m_bottom.load(std::memory_order_relaxed)-1;
+            Array* a=m_array.load(std::memory_order_relaxed);
+            m_bottom.store(b,std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t=m_top.load(std::memory_order_relaxed);
+            if(t>b){
+                m_bottom.store(b+1,std::memory_order_relaxed);
+                return nullptr;
+            }
+            Task* task=a->get(b);
+            if(t==b){
+                // 只剩最后一个任务，和窃取者竞争
+                if(!m_top.compare_exchange_strong(t,t+1,std::memory_order_seq_cst,std::memory_order_relaxed)){
+                    task=nullptr;
+                }
+                m_bottom.store(b+1,std::memory_order_relaxed);
+            }
+            return task;
+        }
+
+        // 任意线程调用，从队头取
+        Task* steal(){
+            int64_t t=m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b=m_bottom.load(std::memory_order_acquire);
+            if(t>=b) return nullptr;
+            Array* a=m_array.load(std::memory_order_acquire);
+            Task* task=a->get(t);
+            if(!m_top.compare_exchange_strong(t,t+1,std::memory_order_seq_cst,std::memory_order_relaxed)){
+                return nullptr;
+            }
+            return task;
+        }
+
+    private:
+        struct Array{
+            explicit Array(int64_t n):size(n),buf(new std::atomic<Task*>[n]){}
+            ~Array(){delete[] buf;}
+            Task* get(int64_t i) const {return buf[i&(size-1)].load(std::memory_order_relaxed);}
+            void put(int64_t i,Task* task){buf[i&(size-1)].store(task,std::memory_order_relaxed);}
+            int64_t size;
+            std::atomic<Task*>* buf;
+        };
+
+        std::atomic<int64_t> m_top;
+        std::atomic<int64_t> m_bottom;
+        std::atomic<Array*> m_array;
+        std::vector<Array*> m_garbage;
+    };
+
+    struct Worker{
+        WorkDeque deque;
+        std::mutex inboxMutex;      // 外部线程投递的任务
+        std::deque<Task*> inbox;
+        std::minstd_rand rng;
+    };
+
+    struct ThreadContext{
+        ThreadPool* pool;
+        size_t index;
+    };
+
+    std::atomic<bool>m_stop;
     std::vector<std::thread>m_thread;
-    std::queue<std::function<void()>>tasks;
+    std::vector<std::unique_ptr<Worker>>m_workers;
+    std::atomic<size_t>m_next;      // 外部提交时轮流选择收件箱
+    std::atomic<long>m_queued;      // 已提交但尚未被取走的任务数
+    std::atomic<int>m_sleepers;     // 挂起的线程数
     std::mutex m_mutex;
     std::condition_variable m_cv;
 
+    // 当前线程所属的线程池以及在池中的下标
+    static ThreadContext& context(){
+        static thread_local ThreadContext ctx={nullptr,0};
+        return ctx;
+    }
+
+    Task* takeInbox(Worker& w,bool moveRest){
+        std::unique_lock<std::mutex>lk(w.inboxMutex);
+        if(w.inbox.empty()) return nullptr;
+        Task* task=w.inbox.front();
+        w.inbox.pop_front();
+        // 自己的收件箱整批转入无锁队列，便于其他线程窃取
+        if(moveRest){
+            for(auto t:w.inbox) w.deque.push(t);
+            w.inbox.clear();
+        }
+        return task;
+    }
+
+    Task* findTask(size_t self){
+        Worker& w=*m_workers[self];
+        Task* task=w.deque.pop();
+        if(!task) task=takeInbox(w,true);
+        if(task) return task;
+        // 随机选择起点依次窃取其他线程
+        size_t n=m_workers.size();
+        size_t start=w.rng()%n;
+        for(size_t i=0;i<n&&!task;++i){
+            size_t victim=(start+i)%n;
+            if(victim==self) continue;
+            task=m_workers[victim]->deque.steal();
+            if(!task) task=takeInbox(*m_workers[victim],false);
+        }
+        return task;
+    }
+
+    void workerLoop(size_t self){
+        context().pool=this;
+        context().index=self;
+        for(;;)
+        {
+            Task* task=findTask(self);
+            if(task){
+                m_queued.fetch_sub(1);
+                task->run();
+                TaskSlotPool::release(task);
+                continue;
+            }
+            // unique_lock 被用来在条件变量上等待和保护临界区
+            std::unique_lock<std::mutex>lk(m_mutex);
+            m_sleepers.fetch_add(1);
+            // 登记挂起后再检查一次，避免和提交者错过唤醒
+            if(m_queued.load()>0){
+                m_sleepers.fetch_sub(1);
+                continue;
+            }
+            // 线程会退出死循环
+            if(m_stop){
+                m_sleepers.fetch_sub(1);
+                return;
+            }
+            m_cv.wait(lk);
+            m_sleepers.fetch_sub(1);
+        }
+    }
+
+    void schedule(Task* task){
+        ThreadContext& ctx=context();
+        if(ctx.pool==this){
+            // 工作线程提交的任务优先留在自己的队列
+            m_workers[ctx.index]->deque.push(task);
+        }
+        else{
+            Worker& w=*m_workers[m_next.fetch_add(1,std::memory_order_relaxed)%m_workers.size()];
+            std::unique_lock<std::mutex>lk(w.inboxMutex);
+            w.inbox.push_back(task);
+        }
+        m_queued.fetch_add(1);
+        // 有挂起的线程时唤醒一个
+        if(m_sleepers.load()>0){
+            { std::unique_lock<std::mutex>lk(m_mutex); }
+            m_cv.notify_one();
+        }
+    }
+
 public:
-    explicit ThreadPool(size_t threadNumber):m_stop(false){
+    explicit ThreadPool(size_t threadNumber):m_stop(false),m_next(0),m_queued(0),m_sleepers(0){
+        if(threadNumber==0) threadNumber=1;
+        for(size_t i=0;i<threadNumber;++i)
+        {
+            m_workers.emplace_back(new Worker());
+            m_workers.back()->rng.seed(static_cast<unsigned>(i+1));
+        }
         for(size_t i=0;i<threadNumber;++i)
         {
             // 所有创建的线程都被加入到成员变量 m_thread 中
-            m_thread.emplace_back(
-                [this](){
-                    for(;;)
-                    {
-                        std::function<void()>task;
-                        {
-                            // unique_lock 被用来在条件变量上等待和保护临界区
-                            std::unique_lock<std::mutex>lk(m_mutex);
-                            // 等待的条件是当 m_stop 为 true 时或者任务队列 tasks 不为空时，线程就可以被唤醒
-                            // 阻塞时自动释放锁，当被唤醒时重新获得锁，在结束此轮循环时 lk 析构解锁
-                            m_cv.wait(lk,[this](){ return m_stop||!tasks.empty();});
-                            // 线程会退出死循环
-                            if(m_stop&&tasks.empty()) return;
-                            // 线程会从任务队列中取出一个任务并执行
-                            task=std::move(tasks.front());
-                            tasks.pop();
-                        }
-                        task();
-                    }
-                }
-            );
+            m_thread.emplace_back(&ThreadPool::workerLoop,this,i);
         }
     }
 
@@ -54,12 +355,12 @@ public:
     ThreadPool & operator=(ThreadPool &&) = delete;
 
     ~ThreadPool(){
-        // 先加锁，确保其他线程无法修改 m_stop 标志位
+        // 先加锁，确保挂起的线程不会错过 m_stop 标志位
         {
             std::unique_lock<std::mutex>lk(m_mutex);
             m_stop=true;
         }
-        // 通知所有线程 m_stop 标志位已经置为 true，让所有线程退出循环
+        // 通知所有线程 m_stop 标志位已经置为 true，线程执行完剩余任务后退出循环
         m_cv.notify_all();
         // 等待所有线程结束
         for(auto& threads:m_thread)
@@ -67,7 +368,16 @@ public:
             threads.join();
         }
     }
-    /* submit函数用于向线程池提交一个任务 */
+    /* post函数提交一个不关心结果的任务，可调用对象直接放进池化的任务槽 */
+    template<typename F>
+    void post(F&& f){
+        if(m_stop) throw std::runtime_error("post on stopped ThreadPool");
+        Task* task=TaskSlotPool::acquire();
+        task->emplace(std::forward<F>(f));
+        schedule(task);
+    }
+
+    /* submit函数用于向线程池提交一个任务，需要获取结果时使用 */
     template<typename F,typename... Args>
     // 用 decltype 推导出函数 f 的返回值类型，并返回一个 std::future 对象, 用于异步地获取函数执行的结果
     auto submit(F&& f,Args&&... args)->std::future<decltype(f(args...))>{
@@ -77,13 +387,8 @@ public:
             // 使用 std::bind 将可变数量的参数传递给函数 f
             std::bind(std::forward<F>(f),std::forward<Args>(args)...)
         );
-        {
-            std::unique_lock<std::mutex>lk(m_mutex);
-            if(m_stop) throw std::runtime_error("submit on stopped ThreadPool");
-            tasks.emplace([taskPtr](){ (*taskPtr)(); });
-        }
-        // 唤醒一个等待中的线程，以便执行新提交的任务。
-        m_cv.notify_one();
+        if(m_stop) throw std::runtime_error("submit on stopped ThreadPool");
+        post([taskPtr](){ (*taskPtr)(); });
         return taskPtr->get_future();
 
     }
@@ -102,3 +407,8 @@ public:
 // }
 // for(auto && result: results)
 //     std::cout << result.get() << ' ';
+
+// 不需要结果时使用 post，不会创建 future
+// pool.post([]() {
+//     // fire-and-forget task
+// });
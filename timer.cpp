@@ -17,12 +17,12 @@ up操作：比父结点小，与父结点交换
 
 void TimerManager::siftup_(size_t i) {
     assert(i >= 0 && i < heap_.size());
-    size_t j = (i - 1) / 2;
-    while(j >= 0) {
+    // size_t 没有负数，到达根结点时必须停下，否则 (i - 1) / 2 会回绕成极大的下标
+    while(i > 0) {
+        size_t j = (i - 1) / 2;
         if(heap_[j] < heap_[i]) { break; }
         swapNode_(i, j);
         i = j;
-        j = (i - 1) / 2;
     }
 }
 
@@ -11,9 +11,9 @@
 #include<functional>
 #include<memory>
 
+#include "timewheel.h"
 #include "HTTPconnection.h"
 
-typedef std::function<void()> TimeoutCallBack;
 typedef std::chrono::high_resolution_clock Clock;
 typedef std::chrono::milliseconds MS;
 typedef Clock::time_point TimeStamp;
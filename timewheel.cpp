@@ -0,0 +1,184 @@
+// encode UTF-8
+
+#include "timewheel.h"
+
+TimeWheel::TimeWheel(int tickMS):tickMS_(tickMS>0?tickMS:1),now_(0),start_(WheelClock::now())
+{
+    for(int level=0;level<LEVELS;++level) {
+        occupied_[level]=0;
+        for(int i=0;i<SLOTS;++i) {
+            slots_[level][i].prev=slots_[level][i].next=&slots_[level][i];
+        }
+    }
+}
+
+int64_t TimeWheel::currentTick_() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(WheelClock::now()-start_).count()/tickMS_;
+}
+
+/* 向上取整到 tick，保证不会提前触发 */
+int64_t TimeWheel::expireTick_(int timeout) const
+{
+    int64_t ticks=(timeout+tickMS_-1)/tickMS_;
+    return currentTick_()+(ticks>0?ticks:1);
+}
+
+void TimeWheel::pushBack_(TimeWheelNode* head,TimeWheelNode* node)
+{
+    node->prev=head->prev;
+    node->next=head;
+    head->prev->next=node;
+    head->prev=node;
+}
+
+/* 按距离到期的 tick 数选择层：差值落在 64^(i+1) 以内的挂到第 i 层 */
+void TimeWheel::insert_(TimeWheelNode* node)
+{
+    if(node->expire<now_) node->expire=now_;
+    int64_t delta=node->expire-now_;
+    int level=0;
+    while(level<LEVELS-1 && delta>=(int64_t(1)<<(SLOT_BITS*(level+1)))) {
+        ++level;
+    }
+    int64_t index;
+    if(delta>=(int64_t(1)<<(SLOT_BITS*LEVELS))) {
+        // 超出时间轮范围，先挂到最高层最远的槽，到时再重新计算
+        index=((now_>>(SLOT_BITS*level))-1)&SLOT_MASK;
+    }
+    else {
+        index=(node->expire>>(SLOT_BITS*level))&SLOT_MASK;
+    }
+    pushBack_(&slots_[level][index],node);
+    occupied_[level]|=uint64_t(1)<<index;
+}
+
+void TimeWheel::add(TimeWheelNode* node,int timeout,const TimeoutCallBack& cb)
+{
+    assert(node);
+    node->unlink();
+    node->expire=expireTick_(timeout);
+    node->cb=cb;
+    insert_(node);
+}
+
+void TimeWheel::refresh(TimeWheelNode* node,int timeout)
+{
+    assert(node && node->linked());
+    int64_t expire=expireTick_(timeout);
+    if(expire>=node->expire) {
+        // 延后：结点留在原来的槽里，到时再挪
+        node->expire=expire;
+        return;
+    }
+    // 提前：必须重新挂到更早的槽
+    node->unlink();
+    node->expire=expire;
+    insert_(node);
+}
+
+void TimeWheel::cancel(TimeWheelNode* node)
+{
+    assert(node);
+    node->unlink();
+}
+
+/* 把高层的一个槽重新分配到低层 */
+void TimeWheel::cascade_(int level,int64_t index)
+{
+    TimeWheelNode* head=&slots_[level][index];
+    occupied_[level]&=~(uint64_t(1)<<index);
+    TimeWheelNode pending;
+    if(head->next==head) return;
+    // 整条链表转移到临时哨兵下，再逐个重新插入
+    pending.next=head->next;
+    pending.prev=head->prev;
+    pending.next->prev=&pending;
+    pending.prev->next=&pending;
+    head->prev=head->next=head;
+    while(pending.next!=&pending) {
+        TimeWheelNode* node=pending.next;
+        node->unlink();
+        insert_(node);
+    }
+    pending.prev=pending.next=&pending;
+}
+
+/* 前进一个 tick：必要时逐层下放，然后处理第 0 层当前槽 */
+void TimeWheel::tick_()
+{
+    ++now_;
+    for(int level=1;level<LEVELS;++level) {
+        if((now_&((int64_t(1)<<(SLOT_BITS*level))-1))!=0) break;
+        cascade_(level,(now_>>(SLOT_BITS*level))&SLOT_MASK);
+    }
+
+    int64_t index=now_&SLOT_MASK;
+    TimeWheelNode* head=&slots_[0][index];
+    occupied_[0]&=~(uint64_t(1)<<index);
+    if(head->next==head) return;
+    TimeWheelNode pending;
+    pending.next=head->next;
+    pending.prev=head->prev;
+    pending.next->prev=&pending;
+    pending.prev->next=&pending;
+    head->prev=head->next=head;
+    // 回调里可能取消或重设其他结点，每次只取链表头
+    while(pending.next!=&pending) {
+        TimeWheelNode* node=pending.next;
+        node->unlink();
+        if(node->expire>now_) {
+            // 期间被刷新过，按新的到期时间重新挂上
+            insert_(node);
+            continue;
+        }
+        TimeoutCallBack cb=node->cb;
+        cb();
+    }
+    pending.prev=pending.next=&pending;
+}
+
+/* 距离下一个可能有结点到期的 tick 数 */
+int TimeWheel::ticksToNext_() const
+{
+    int best=-1;
+    uint64_t bits=occupied_[0];
+    if(bits) {
+        int shift=static_cast<int>((now_+1)&SLOT_MASK);
+        uint64_t rotated=shift?((bits>>shift)|(bits<<(SLOTS-shift))):bits;
+        best=__builtin_ctzll(rotated)+1;
+    }
+    for(int level=1;level<LEVELS;++level) {
+        if(occupied_[level]) {
+            // 高层有结点时至少要在第 0 层转完一圈时醒来下放
+            int wrap=static_cast<int>(SLOTS-(now_&SLOT_MASK));
+            if(best<0 || wrap<best) best=wrap;
+            break;
+        }
+    }
+    return best;
+}
+
+int TimeWheel::getNextHandle()
+{
+    int64_t target=currentTick_();
+    while(now_<target) {
+        tick_();
+    }
+    int ticks=ticksToNext_();
+    if(ticks<0) return -1;
+    int64_t elapsed=std::chrono::duration_cast<std::chrono::milliseconds>(WheelClock::now()-start_).count();
+    int64_t res=(now_+ticks)*tickMS_-elapsed;
+    return res>0?static_cast<int>(res):0;
+}
+
+void TimeWheel::clear()
+{
+    for(int level=0;level<LEVELS;++level) {
+        occupied_[level]=0;
+        for(int i=0;i<SLOTS;++i) {
+            TimeWheelNode* head=&slots_[level][i];
+            while(head->next!=head) head->next->unlink();
+        }
+    }
+}
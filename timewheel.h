@@ -0,0 +1,78 @@
+// encode UTF-8
+
+#ifndef TIMEWHEEL_H
+#define TIMEWHEEL_H
+
+#include<chrono>
+#include<functional>
+#include<assert.h>
+#include<stdint.h>
+
+typedef std::function<void()> TimeoutCallBack;
+
+/* 侵入式定时器结点，嵌在连接对象里，不需要额外分配和查表 */
+class TimeWheelNode{
+public:
+    TimeWheelNode():prev(nullptr),next(nullptr),expire(0){}
+    ~TimeWheelNode() {unlink();}
+
+    bool linked() const {return next!=nullptr;}
+    void unlink()
+    {
+        if(!linked()) return;
+        prev->next=next;
+        next->prev=prev;
+        prev=next=nullptr;
+    }
+
+    TimeWheelNode* prev;
+    TimeWheelNode* next;
+    int64_t expire;      //到期的 tick
+    TimeoutCallBack cb;
+};
+
+/* 分层时间轮
+4 层，每层 64 个槽，第 0 层每槽一个 tick，第 i 层每槽 64^i 个 tick，
+插入、刷新、取消都是 O(1)。刷新只改写结点的到期 tick，不移动结点：
+结点所在的槽到期时再检查，未到期就按新的到期时间重新挂到合适的槽里 */
+class TimeWheel{
+public:
+    explicit TimeWheel(int tickMS=10);
+    ~TimeWheel() {clear();}
+
+    //设置定时器，结点已在时间轮中时相当于重新设置
+    void add(TimeWheelNode* node,int timeout,const TimeoutCallBack& cb);
+    //重设定时器的超时时间，延后时只改写到期时间
+    void refresh(TimeWheelNode* node,int timeout);
+    //取消定时器
+    void cancel(TimeWheelNode* node);
+    //推进时间轮并处理到期的定时器，返回下一次需要唤醒的毫秒数，没有定时器时返回-1
+    int getNextHandle();
+
+    void clear();
+
+private:
+    typedef std::chrono::steady_clock WheelClock;
+
+    static const int LEVELS=4;
+    static const int SLOT_BITS=6;
+    static const int SLOTS=1<<SLOT_BITS;
+    static const int64_t SLOT_MASK=SLOTS-1;
+
+    int64_t currentTick_() const;
+    int64_t expireTick_(int timeout) const;
+    void insert_(TimeWheelNode* node);
+    void tick_();
+    void cascade_(int level,int64_t index);
+    int ticksToNext_() const;
+
+    static void pushBack_(TimeWheelNode* head,TimeWheelNode* node);
+
+    int tickMS_;
+    int64_t now_;        //已经处理到的 tick
+    WheelClock::time_point start_;
+    TimeWheelNode slots_[LEVELS][SLOTS]; //每个槽是一个带哨兵的双向循环链表
+    uint64_t occupied_[LEVELS];          //非空槽的位图，结点被直接摘除时可能残留，只会多唤醒一次
+};
+
+#endif //TIMEWHEEL_H
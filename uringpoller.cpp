@@ -0,0 +1,235 @@
+// encode UTF-8
+
+#include "uringpoller.h"
+#include <string.h>
+
+UringPoller::UringPoller(int maxEvent):Epoller(maxEvent,-1),ringFd_(-1),
+    sqPtr_(MAP_FAILED),sqSize_(0),sqTailLocal_(0),sqes_(nullptr),sqesSize_(0),
+    cqPtr_(MAP_FAILED),cqSize_(0)
+{
+    // 提交队列大小与一次能返回的事件数一致，完成队列由内核默认设为两倍
+    unsigned entries=1;
+    while(entries<events_.size()) entries<<=1;
+    if(!setup_(entries) && ringFd_>=0) {
+        close(ringFd_);
+        ringFd_=-1;
+    }
+}
+
+UringPoller::~UringPoller()
+{
+    if(sqes_) munmap(sqes_,sqesSize_);
+    if(cqPtr_!=MAP_FAILED && cqPtr_!=sqPtr_) munmap(cqPtr_,cqSize_);
+    if(sqPtr_!=MAP_FAILED) munmap(sqPtr_,sqSize_);
+    if(ringFd_>=0) close(ringFd_);
+}
+
+/* 创建 io_uring 实例并映射提交队列、完成队列和 SQE 数组 */
+bool UringPoller::setup_(unsigned entries)
+{
+    io_uring_params p;
+    memset(&p,0,sizeof(p));
+    ringFd_=syscall(__NR_io_uring_setup,entries,&p);
+    if(ringFd_<0) return false;
+    // 需要带超时的 io_uring_enter，且完成队列满时不能丢事件
+    if(!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) return false;
+
+    sqSize_=p.sq_off.array+p.sq_entries*sizeof(unsigned);
+    cqSize_=p.cq_off.cqes+p.cq_entries*sizeof(io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        sqSize_=cqSize_=std::max(sqSize_,cqSize_);
+    }
+    sqPtr_=mmap(0,sqSize_,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ringFd_,IORING_OFF_SQ_RING);
+    if(sqPtr_==MAP_FAILED) return false;
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        cqPtr_=sqPtr_;
+    }
+    else {
+        cqPtr_=mmap(0,cqSize_,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ringFd_,IORING_OFF_CQ_RING);
+        if(cqPtr_==MAP_FAILED) return false;
+    }
+    sqesSize_=p.sq_entries*sizeof(io_uring_sqe);
+    void* sqes=mmap(0,sqesSize_,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ringFd_,IORING_OFF_SQES);
+    if(sqes==MAP_FAILED) return false;
+    sqes_=static_cast<io_uring_sqe*>(sqes);
+
+    char* sq=static_cast<char*>(sqPtr_);
+    sqHead_=reinterpret_cast<unsigned*>(sq+p.sq_off.head);
+    sqTail_=reinterpret_cast<unsigned*>(sq+p.sq_off.tail);
+    sqMask_=*reinterpret_cast<unsigned*>(sq+p.sq_off.ring_mask);
+    sqEntries_=p.sq_entries;
+    sqTailLocal_=*sqTail_;
+    // SQE 按顺序使用，索引数组固定为恒等映射
+    unsigned* array=reinterpret_cast<unsigned*>(sq+p.sq_off.array);
+    for(unsigned i=0;i<sqEntries_;++i) array[i]=i;
+
+    char* cq=static_cast<char*>(cqPtr_);
+    cqHead_=reinterpret_cast<unsigned*>(cq+p.cq_off.head);
+    cqTail_=reinterpret_cast<unsigned*>(cq+p.cq_off.tail);
+    cqMask_=*reinterpret_cast<unsigned*>(cq+p.cq_off.ring_mask);
+    cqes_=reinterpret_cast<io_uring_cqe*>(cq+p.cq_off.cqes);
+    return true;
+}
+
+int UringPoller::enter_(unsigned toSubmit,unsigned minComplete,unsigned flags,void* arg,size_t argSize)
+{
+    return syscall(__NR_io_uring_enter,ringFd_,toSubmit,minComplete,flags,arg,argSize);
+}
+
+/* 取一个空闲的 SQE，提交队列满时先把已有的提交掉 */
+io_uring_sqe* UringPoller::getSqe_()
+{
+    unsigned head=__atomic_load_n(sqHead_,__ATOMIC_ACQUIRE);
+    if(sqTailLocal_-head>=sqEntries_) {
+        enter_(sqTailLocal_-head,0,0,nullptr,0);
+        head=__atomic_load_n(sqHead_,__ATOMIC_ACQUIRE);
+        if(sqTailLocal_-head>=sqEntries_) return nullptr;
+    }
+    io_uring_sqe* sqe=&sqes_[sqTailLocal_&sqMask_];
+    memset(sqe,0,sizeof(*sqe));
+    ++sqTailLocal_;
+    return sqe;
+}
+
+UringPoller::FdState& UringPoller::state_(int fd)
+{
+    if(static_cast<size_t>(fd)>=fds_.size()) fds_.resize(fd+1);
+    return fds_[fd];
+}
+
+/* 为 fd 挂一个 poll 请求
+EPOLLONESHOT 和水平触发都用单次 poll（水平触发在每次完成后自动重挂），
+边沿触发且非 oneshot 的描述符（如ET模式的监听套接字）用 multishot poll */
+void UringPoller::arm_(int fd)
+{
+    FdState& st=state_(fd);
+    io_uring_sqe* sqe=getSqe_();
+    if(!sqe) return;
+    sqe->opcode=IORING_OP_POLL_ADD;
+    sqe->fd=fd;
+    sqe->poll32_events=st.events & ~(EPOLLONESHOT | EPOLLET);
+    if(!(st.events & EPOLLONESHOT) && (st.events & EPOLLET)) {
+        sqe->len=IORING_POLL_ADD_MULTI;
+    }
+    sqe->user_data=userData_(fd,st.seq);
+    st.armed=true;
+}
+
+void UringPoller::disarm_(int fd)
+{
+    FdState& st=state_(fd);
+    if(!st.armed) return;
+    io_uring_sqe* sqe=getSqe_();
+    if(!sqe) return;
+    sqe->opcode=IORING_OP_POLL_REMOVE;
+    sqe->fd=-1;
+    sqe->addr=userData_(fd,st.seq);
+    sqe->user_data=IGNORE_DATA;
+    st.armed=false;
+}
+
+/* 非事件循环线程的修改立即提交 */
+void UringPoller::submitIfForeign_()
+{
+    if(std::this_thread::get_id()==loopThread_) return;
+    unsigned head=__atomic_load_n(sqHead_,__ATOMIC_ACQUIRE);
+    __atomic_store_n(sqTail_,sqTailLocal_,__ATOMIC_RELEASE);
+    enter_(sqTailLocal_-head,0,0,nullptr,0);
+}
+
+bool UringPoller::addFd(int fd,uint32_t events)
+{
+    if(fd<0) return false;
+    std::lock_guard<std::mutex> lk(mtx_);
+    FdState& st=state_(fd);
+    if(st.registered) return false;
+    st.registered=true;
+    st.events=events;
+    ++st.seq;
+    arm_(fd);
+    submitIfForeign_();
+    return true;
+}
+
+bool UringPoller::modFd(int fd,uint32_t events)
+{
+    if(fd<0) return false;
+    std::lock_guard<std::mutex> lk(mtx_);
+    FdState& st=state_(fd);
+    if(!st.registered) return false;
+    disarm_(fd);
+    st.events=events;
+    ++st.seq;
+    arm_(fd);
+    submitIfForeign_();
+    return true;
+}
+
+bool UringPoller::delFd(int fd)
+{
+    if(fd<0) return false;
+    std::lock_guard<std::mutex> lk(mtx_);
+    FdState& st=state_(fd);
+    if(!st.registered) return false;
+    disarm_(fd);
+    st.registered=false;
+    ++st.seq;
+    submitIfForeign_();
+    return true;
+}
+
+/* 一次 io_uring_enter 同时提交积压的 poll 请求并等待完成事件 */
+int UringPoller::wait(int timeoutMs)
+{
+    unsigned toSubmit;
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        loopThread_=std::this_thread::get_id();
+        unsigned head=__atomic_load_n(sqHead_,__ATOMIC_ACQUIRE);
+        __atomic_store_n(sqTail_,sqTailLocal_,__ATOMIC_RELEASE);
+        toSubmit=sqTailLocal_-head;
+    }
+
+    __kernel_timespec ts;
+    io_uring_getevents_arg arg;
+    memset(&arg,0,sizeof(arg));
+    if(timeoutMs>=0) {
+        ts.tv_sec=timeoutMs/1000;
+        ts.tv_nsec=(timeoutMs%1000)*1000000LL;
+        arg.ts=reinterpret_cast<uint64_t>(&ts);
+    }
+    unsigned flags=IORING_ENTER_EXT_ARG;
+    // 完成队列已有事件时不再阻塞
+    unsigned pending=__atomic_load_n(cqTail_,__ATOMIC_ACQUIRE)-*cqHead_;
+    if(pending==0 && timeoutMs!=0) flags|=IORING_ENTER_GETEVENTS;
+    int ret=enter_(toSubmit,(flags & IORING_ENTER_GETEVENTS)?1:0,flags,&arg,sizeof(arg));
+    if(ret<0 && errno!=ETIME && errno!=EINTR && errno!=EBUSY) return -1;
+
+    std::lock_guard<std::mutex> lk(mtx_);
+    int n=0;
+    unsigned head=*cqHead_;
+    unsigned tail=__atomic_load_n(cqTail_,__ATOMIC_ACQUIRE);
+    while(head!=tail && static_cast<size_t>(n)<events_.size()) {
+        const io_uring_cqe& cqe=cqes_[head&cqMask_];
+        ++head;
+        if(cqe.user_data==IGNORE_DATA) continue;
+        int fd=static_cast<int>(cqe.user_data&0xffffffffu);
+        uint32_t seq=static_cast<uint32_t>(cqe.user_data>>32);
+        if(static_cast<size_t>(fd)>=fds_.size()) continue;
+        FdState& st=fds_[fd];
+        // 已删除或已重新注册，丢弃过期事件
+        if(!st.registered || st.seq!=seq) continue;
+        if(!(cqe.flags & IORING_CQE_F_MORE)) st.armed=false;
+        if(cqe.res<0) {
+            if(!st.armed && !(st.events & EPOLLONESHOT)) arm_(fd);
+            continue;
+        }
+        events_[n].data.fd=fd;
+        events_[n].events=static_cast<uint32_t>(cqe.res);
+        ++n;
+        // 水平触发的非 oneshot 描述符重新挂上，随下一次 wait 一起提交
+        if(!st.armed && !(st.events & EPOLLONESHOT)) arm_(fd);
+    }
+    __atomic_store_n(cqHead_,head,__ATOMIC_RELEASE);
+    return n;
+}
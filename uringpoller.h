@@ -0,0 +1,75 @@
+// encode UTF-8
+
+#ifndef URING_POLLER_H
+#define URING_POLLER_H
+
+#include<linux/io_uring.h>
+#include<sys/syscall.h> //io_uring_setup() io_uring_enter()
+#include<sys/mman.h> //mmap()
+#include<thread>
+#include<mutex>
+#include<vector>
+
+#include "epoller.h"
+
+/* 基于 io_uring 的事件后端，对外保持和 Epoller 一样的就绪通知语义
+addFd/modFd/delFd 只是往提交队列里放 POLL_ADD/POLL_REMOVE，
+由事件循环线程在 wait 中和收割完成事件合并为一次 io_uring_enter；
+其他线程（线程池）修改事件时立即提交，避免事件循环阻塞时修改不生效 */
+class UringPoller:public Epoller{
+public:
+    explicit UringPoller(int maxEvent=1024);
+    ~UringPoller();
+
+    bool isValid() const {return ringFd_>=0;}
+
+    bool addFd(int fd,uint32_t events) override;
+    bool modFd(int fd,uint32_t events) override;
+    bool delFd(int fd) override;
+    int wait(int timeoutMs = -1) override;
+
+private:
+    struct FdState{
+        uint32_t seq=0;        //每次重新注册自增，用来丢弃过期的完成事件
+        uint32_t events=0;
+        bool registered=false;
+        bool armed=false;      //内核中是否有挂着的poll请求
+    };
+
+    bool setup_(unsigned entries);
+    void arm_(int fd);           //调用者持有锁
+    void disarm_(int fd);        //调用者持有锁
+    io_uring_sqe* getSqe_();     //调用者持有锁
+    int enter_(unsigned toSubmit,unsigned minComplete,unsigned flags,void* arg,size_t argSize);
+    void submitIfForeign_();     //调用者持有锁
+    FdState& state_(int fd);     //调用者持有锁
+
+    static uint64_t userData_(int fd,uint32_t seq) {return (uint64_t(seq)<<32)|uint32_t(fd);}
+    static const uint64_t IGNORE_DATA=~uint64_t(0);
+
+    int ringFd_;
+    std::mutex mtx_;
+    std::thread::id loopThread_;  //调用 wait 的线程，在该线程内的修改延迟到下次 wait 批量提交
+    std::vector<FdState> fds_;
+
+    // 提交队列
+    void* sqPtr_;
+    size_t sqSize_;
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    unsigned sqTailLocal_;
+    io_uring_sqe* sqes_;
+    size_t sqesSize_;
+
+    // 完成队列
+    void* cqPtr_;
+    size_t cqSize_;
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe* cqes_;
+};
+
+#endif //URING_POLLER_H
@@ -3,7 +3,8 @@
 #ifndef WEBSERVER_H
 #define WEBSERVER_H
 
-#include <unordered_map>
+#include <vector>
+#include <thread>
 #include <fcntl.h>       // fcntl()
 #include <unistd.h>      // close()
 #include <assert.h>
@@ -12,57 +13,44 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
-#include "epoller.h"
-#include "timer.h"
+#include "reactor.h"
 #include "threadpool.h"
 #include "HTTPconnection.h"
 
 class WebServer {
 public:
-    WebServer(int port,int trigMode,int timeoutMS,bool optLinger,int threadNum);
+    // multiReactor 为 true 时每个线程持有一个事件循环和一个 SO_REUSEPORT 监听套接字，
+    // 由内核把新连接分散到各个线程，此时 threadNum 即事件循环的个数，不再创建线程池
+    // useUring 为 true 时事件循环使用 io_uring 后端，内核不支持时自动退回 epoll
+    // timeWheel 为 true 时用分层时间轮代替小根堆管理超时连接
+    // sendFile 为 true 时不在缓存中的文件用 sendfile 发送，不映射到用户空间
+    WebServer(int port,int trigMode,int timeoutMS,bool optLinger,int threadNum,
+              bool multiReactor=false,bool useUring=false,bool timeWheel=false,bool sendFile=false);
     ~WebServer();
 
     void Start(); //一切的开始
 
 private:
-    //对服务端的socket进行设置，最后可以得到listenFd
-    bool initSocket_(); 
+    //对服务端的socket进行设置，成功返回listenFd，失败返回-1
+    int initSocket_(bool reusePort);
     
     void initEventMode_(int trigMode);
 
-    void addClientConnection(int fd, sockaddr_in addr); //添加一个HTTP连接
-    void closeConn_(HTTPconnection* client);            //关闭一个HTTP连接
-
-  
-    void handleListen_();
-    void handleWrite_(HTTPconnection* client);
-    void handleRead_(HTTPconnection* client);
-
-    void onRead_(HTTPconnection* client);
-    void onWrite_(HTTPconnection* client);
-    void onProcess_(HTTPconnection* client);
-
-    void sendError_(int fd, const char* info);
-    void extentTime_(HTTPconnection* client);
-
-    static const int MAX_FD = 65536;
-    static int setFdNonblock(int fd);
-
     int port_;
     int timeoutMS_;  /* 毫秒MS,定时器的默认过期时间 */
     bool isClose_;
-    int listenFd_;
     bool openLinger_;
+    bool multiReactor_;
+    bool useUring_;
+    bool timeWheel_;
     char* srcDir_;//需要获取的路径
     
     uint32_t listenEvent_;
     uint32_t connectionEvent_;
    
-    std::unique_ptr<TimerManager>timer_;
     std::unique_ptr<ThreadPool> threadpool_;
-    std::unique_ptr<Epoller> epoller_;
-    std::unordered_map<int, HTTPconnection> users_;
+    std::vector<std::unique_ptr<Reactor>> reactors_;
 };
 
 
-#endif //WEBSERVER_H
\ No newline at end of file
+#endif //WEBSERVER_H